@@ -0,0 +1,354 @@
+#pragma once
+#include <math.h>
+#include "snake.h"
+
+// Arena
+
+// Many snakes on one big board stepped together, whoever plays them (bots, replays or local players)
+// only hands in an input per snake per tick, with the same turning rules as game_input
+// A body is a ring of cell indexes from the tail to the head, so a move is a push and a pop whatever
+// the length, and the board is an occupancy grid of which snake holds each cell
+// Moves are simultaneous: every head's next cell goes in a spatial hash, open addressing keyed by the
+// cell and rebuilt each tick, so heads heading for the same cell find each other without looking at
+// any body. A head dies there, or on any body cell but a tail that leaves on the same tick
+// A tick costs O(snakes) whatever their length, only a death walks a body to free its cells
+
+#define ARENA_MAX_TILES  255
+#define ARENA_MAX_SNAKES 0xfffe
+#define ARENA_RESPAWN    8  // Ticks a dead snake waits before it tries to come back
+#define ARENA_TRIES      8  // Random cells tried for a respawn or an apple before leaving it for the next tick
+#define ARENA_RING       16 // A body's ring starts this big and doubles as it fills
+#define ARENA_AREA       20 // Cells per snake on a board sized by arena_tiles
+
+// A cell of the grid is empty, an apple or the index + 1 of the snake on it
+#define ARENA_EMPTY 0
+#define ARENA_APPLE 0xffff
+
+typedef struct {
+  u32* ring;
+  u32 capacity, tail, size;
+  u8 head[3];
+  u8 dir, last_dir, last_plane_dir;
+  u8 alive, grow, crashed;
+  u16 respawn;
+  u32 next, apples;
+} ArenaSnake;
+
+// A slot of the spatial hash, only slots stamped with the current tick are in it
+typedef struct {
+  u32 cell, stamp, heads;
+} ArenaHead;
+
+typedef struct {
+  u8 tiles;
+  u32 cells, count, alive, tick, rng;
+  u16* grid;
+  ArenaSnake* snakes;
+  ArenaHead* heads;
+  u32 head_mask;
+  u32 *apples, *apple_slots;
+  u32 apple_count, apple_target;
+  u32 events[EVENT_AMOUNT];
+} Arena;
+
+u32 arena_cell(Arena* arena, u32 x, u32 y, u32 z) {
+  return (y * arena->tiles + z) * arena->tiles + x;
+}
+
+void arena_position(Arena* arena, u32 cell, u8 out[3]) {
+  out[0] = cell % arena->tiles;
+  out[1] = cell / (arena->tiles * arena->tiles);
+  out[2] = cell / arena->tiles % arena->tiles;
+}
+
+u32 _arena_rand(Arena* arena, u32 max) {
+  arena->rng ^= arena->rng << 13;
+  arena->rng ^= arena->rng >> 17;
+  arena->rng ^= arena->rng << 5;
+  return arena->rng % max;
+}
+
+// The cell of the ring at i from the tail
+u32 arena_body(ArenaSnake* snake, u32 i) {
+  return snake->ring[(snake->tail + i) & (snake->capacity - 1)];
+}
+
+void _arena_push(ArenaSnake* snake, u32 cell) {
+  if (snake->size == snake->capacity) {
+    // The ring is unrolled into the start of one twice as big
+    u32* ring = malloc(snake->capacity * 2 * sizeof(u32));
+    for (u32 i = 0; i < snake->size; i++) ring[i] = arena_body(snake, i);
+    free(snake->ring);
+    snake->ring = ring;
+    snake->capacity *= 2;
+    snake->tail = 0;
+  }
+  snake->ring[(snake->tail + snake->size++) & (snake->capacity - 1)] = cell;
+}
+
+// Places a dead snake's START_SIZE cells in a straight line on free cells of the lower layer
+u8 _arena_spawn(Arena* arena, u32 i) {
+  ArenaSnake* snake = &arena->snakes[i];
+  u8 dir = _arena_rand(arena, 4), cell[START_SIZE][3];
+  cell[0][0] = _arena_rand(arena, arena->tiles);
+  cell[0][1] = 0;
+  cell[0][2] = _arena_rand(arena, arena->tiles);
+
+  for (u8 j = 0; j < START_SIZE; j++) {
+    if (j) {
+      i32 next[3] = { cell[j - 1][0], cell[j - 1][1], cell[j - 1][2] };
+      game_step_head(next, dir, arena->tiles);
+      VEC3_COPY(next, cell[j]);
+    }
+    if (arena->grid[arena_cell(arena, cell[j][0], cell[j][1], cell[j][2])] != ARENA_EMPTY) return 0;
+  }
+
+  snake->tail = snake->size = 0;
+  for (u8 j = 0; j < START_SIZE; j++) {
+    u32 at = arena_cell(arena, cell[j][0], cell[j][1], cell[j][2]);
+    arena->grid[at] = i + 1;
+    _arena_push(snake, at);
+  }
+
+  VEC3_COPY(cell[START_SIZE - 1], snake->head);
+  snake->dir = snake->last_dir = snake->last_plane_dir = dir;
+  snake->alive = 1;
+  arena->alive++;
+  arena->events[EVENT_START]++;
+  return 1;
+}
+
+// The apples are a list of cells, each cell knows its slot in it so an eaten one is swapped out in O(1)
+void _arena_eat(Arena* arena, u32 cell) {
+  u32 slot = arena->apple_slots[cell], last = arena->apples[--arena->apple_count];
+  arena->apples[slot] = last;
+  arena->apple_slots[last] = slot;
+}
+
+// Tops the apples back up on random free cells
+void _arena_apples(Arena* arena) {
+  u32 missing = arena->apple_target - arena->apple_count;
+  for (u32 tries = 0; arena->apple_count < arena->apple_target && tries < missing * ARENA_TRIES; tries++) {
+    u32 cell = _arena_rand(arena, arena->cells);
+    if (arena->grid[cell] != ARENA_EMPTY) continue;
+    arena->grid[cell] = ARENA_APPLE;
+    arena->apple_slots[cell] = arena->apple_count;
+    arena->apples[arena->apple_count++] = cell;
+  }
+}
+
+// The tiles of a board with about ARENA_AREA cells per snake
+u32 arena_tiles(u32 snakes) {
+  return sqrt(snakes * ARENA_AREA / 2.0) + 1;
+}
+
+// Tiles is clamped to ARENA_MAX_TILES and snakes to ARENA_MAX_SNAKES, the ones that don't fit on the
+// board yet spawn on the following ticks
+void arena_init(Arena* arena, u32 tiles, u32 snakes, u32 apples, u32 seed) {
+  tiles = CLAMP(TILES, tiles, ARENA_MAX_TILES);
+  snakes = MIN(snakes, ARENA_MAX_SNAKES);
+  u32 cells = tiles * tiles * 2;
+
+  // The hash is kept at most half full
+  u32 slots = 1;
+  while (slots < snakes * 2) slots *= 2;
+
+  *arena = (Arena) {
+    .tiles = tiles, .cells = cells, .count = snakes, .rng = seed ? seed : 1,
+    .grid = calloc(cells, sizeof(u16)),
+    .snakes = calloc(snakes, sizeof(ArenaSnake)),
+    .heads = calloc(slots, sizeof(ArenaHead)),
+    .head_mask = slots - 1,
+    .apples = malloc(MIN(apples, cells) * sizeof(u32)),
+    .apple_slots = malloc(cells * sizeof(u32)),
+    .apple_target = MIN(apples, cells)
+  };
+
+  for (u32 i = 0; i < snakes; i++) {
+    ArenaSnake* snake = &arena->snakes[i];
+    snake->ring = malloc(ARENA_RING * sizeof(u32));
+    snake->capacity = ARENA_RING;
+    for (u32 tries = 0; tries < ARENA_TRIES && !_arena_spawn(arena, i); tries++);
+  }
+  _arena_apples(arena);
+}
+
+void arena_free(Arena* arena) {
+  for (u32 i = 0; i < arena->count; i++) free(arena->snakes[i].ring);
+  free(arena->grid);
+  free(arena->snakes);
+  free(arena->heads);
+  free(arena->apples);
+  free(arena->apple_slots);
+}
+
+// Applies an input to a snake, returns 1 when it turned, INPUT_MENU and INPUT_OTHER do nothing here
+u8 arena_input(Arena* arena, u32 i, u8 input) {
+  ArenaSnake* snake = &arena->snakes[i];
+  if (!snake->alive) return 0;
+
+  u8 last = snake->last_dir, dir = snake->dir;
+  switch (input) {
+    case INPUT_UP:    if (last !=  DOWN) dir =    UP; break;
+    case INPUT_DOWN:  if (last !=    UP) dir =  DOWN; break;
+    case INPUT_RIGHT: if (last !=  LEFT) dir = RIGHT; break;
+    case INPUT_LEFT:  if (last != RIGHT) dir =  LEFT; break;
+    case INPUT_LAYER:
+      if      (snake->head[1] == 0 && last !=  BACK) dir = FRONT;
+      else if (snake->head[1] == 1 && last != FRONT) dir =  BACK;
+      break;
+  }
+
+  u8 turned = dir != snake->dir;
+  snake->dir = dir;
+  return turned;
+}
+
+// The slot of cell in the spatial hash, or the free one it would go in, neighbouring cells are spread
+// over the table by the multiply
+ArenaHead* _arena_head(Arena* arena, u32 cell) {
+  u32 slot = cell * 0x9e3779b1 >> 7 & arena->head_mask;
+  while (arena->heads[slot].stamp == arena->tick && arena->heads[slot].cell != cell) slot = (slot + 1) & arena->head_mask;
+  return &arena->heads[slot];
+}
+
+// Whether a snake's cell is free by the time heads move in: it's the tail and the snake didn't eat
+u8 _arena_leaving(Arena* arena, u32 cell) {
+  u16 owner = arena->grid[cell];
+  if (owner == ARENA_EMPTY || owner == ARENA_APPLE) return 1;
+  ArenaSnake* snake = &arena->snakes[owner - 1];
+  return snake->alive && !snake->grow && snake->ring[snake->tail] == cell;
+}
+
+void _arena_die(Arena* arena, u32 i) {
+  ArenaSnake* snake = &arena->snakes[i];
+  for (u32 j = 0; j < snake->size; j++) {
+    u32 cell = arena_body(snake, j);
+    if (arena->grid[cell] == i + 1) arena->grid[cell] = ARENA_EMPTY;
+  }
+
+  snake->size = 0;
+  snake->alive = snake->crashed = 0;
+  snake->respawn = ARENA_RESPAWN;
+  arena->alive--;
+  arena->events[EVENT_DEATH]++;
+}
+
+// Advances every snake by a cell, inputs holds one per snake (anything from INPUT_MENU up is none) or is NULL
+void arena_step(Arena* arena, const u8* inputs) {
+  arena->tick++;
+
+  // Where every head is going, and how many are going there
+  for (u32 i = 0; i < arena->count; i++) {
+    ArenaSnake* snake = &arena->snakes[i];
+    if (!snake->alive) continue;
+    if (inputs) arena_input(arena, i, inputs[i]);
+
+    // Like in game_step the layer switch bounces back to the last plane direction on the other layer
+    if ((snake->dir == FRONT && snake->head[1] == 1) || (snake->dir == BACK && snake->head[1] == 0))
+      snake->dir = snake->last_plane_dir;
+
+    i32 next[3] = { snake->head[0], snake->head[1], snake->head[2] };
+    game_step_head(next, snake->dir, arena->tiles);
+    snake->next = arena_cell(arena, next[0], next[1], next[2]);
+    snake->grow = arena->grid[snake->next] == ARENA_APPLE;
+
+    ArenaHead* head = _arena_head(arena, snake->next);
+    if (head->stamp != arena->tick) *head = (ArenaHead) { snake->next, arena->tick, 0 };
+    head->heads++;
+  }
+
+  // Heads meeting on a cell all die, as do the ones running into a body, the tails moving away
+  // are decided before anything moves so the order the snakes come in doesn't matter
+  for (u32 i = 0; i < arena->count; i++) {
+    ArenaSnake* snake = &arena->snakes[i];
+    if (snake->alive) snake->crashed = _arena_head(arena, snake->next)->heads > 1 || !_arena_leaving(arena, snake->next);
+  }
+
+  // The tails leave first so a head can take a cell freed on the same tick
+  for (u32 i = 0; i < arena->count; i++) {
+    ArenaSnake* snake = &arena->snakes[i];
+    if (!snake->alive || snake->crashed || snake->grow) continue;
+    arena->grid[snake->ring[snake->tail]] = ARENA_EMPTY;
+    snake->tail = (snake->tail + 1) & (snake->capacity - 1);
+    snake->size--;
+  }
+
+  for (u32 i = 0; i < arena->count; i++) {
+    ArenaSnake* snake = &arena->snakes[i];
+    if (!snake->alive || snake->crashed) continue;
+
+    if (snake->grow) {
+      _arena_eat(arena, snake->next);
+      snake->apples++;
+      arena->events[EVENT_APPLE]++;
+    }
+    arena->grid[snake->next] = i + 1;
+    _arena_push(snake, snake->next);
+    arena_position(arena, snake->next, snake->head);
+    snake->last_dir = snake->dir;
+    if (snake->dir != FRONT && snake->dir != BACK) snake->last_plane_dir = snake->dir;
+    arena->events[EVENT_MOVE]++;
+  }
+
+  // Snakes dead for long enough come back where there's room, then the bodies of the ones that
+  // just died are cleared, only where no head has moved in
+  for (u32 i = 0; i < arena->count; i++) {
+    ArenaSnake* snake = &arena->snakes[i];
+    if (snake->alive) continue;
+    if (snake->respawn) snake->respawn--;
+    else for (u32 tries = 0; tries < ARENA_TRIES && !_arena_spawn(arena, i); tries++);
+  }
+  for (u32 i = 0; i < arena->count; i++)
+    if (arena->snakes[i].crashed) _arena_die(arena, i);
+
+  _arena_apples(arena);
+}
+
+// Whether another snake's head is next to cell, so it might move in on the same tick
+u8 _arena_contested(Arena* arena, u32 i, i32 cell[3]) {
+  for (u8 dir = UP; dir <= BACK; dir++) {
+    if (dir == (cell[1] ? FRONT : BACK)) continue;
+    i32 next[3] = { cell[0], cell[1], cell[2] };
+    game_step_head(next, dir, arena->tiles);
+    u16 owner = arena->grid[arena_cell(arena, next[0], next[1], next[2])];
+    if (owner == ARENA_EMPTY || owner == ARENA_APPLE || owner == i + 1) continue;
+    if (VEC3_COMPARE(arena->snakes[owner - 1].head, next)) return 1;
+  }
+  return 0;
+}
+
+// An input for a bot, O(1) per snake: the first of an apple next to the head, the way it's going or
+// any other way that's free and no other head can reach first, with a turn now and then so they
+// spread out, and when there's none a free way another head might take too
+u8 arena_steer(Arena* arena, u32 i) {
+  ArenaSnake* snake = &arena->snakes[i];
+  if (!snake->alive) return INPUT_OTHER;
+
+  static const u8 INPUTS[6] = { [UP] = INPUT_UP, [RIGHT] = INPUT_RIGHT, [DOWN] = INPUT_DOWN, [LEFT] = INPUT_LEFT, [FRONT] = INPUT_LAYER, [BACK] = INPUT_LAYER };
+  u8 apple = 6, ahead = 0, turn = 6, risky = 6, start = _arena_rand(arena, 6);
+
+  for (u8 k = 0; k < 6; k++) {
+    u8 dir = (start + k) % 6;
+    u8 allowed = dir < FRONT ? dir != (snake->last_dir ^ 2) : dir == (snake->head[1] ? BACK : FRONT) && snake->last_dir != (dir ^ 1);
+    if (!allowed) continue;
+
+    i32 next[3] = { snake->head[0], snake->head[1], snake->head[2] };
+    game_step_head(next, dir, arena->tiles);
+    u32 cell = arena_cell(arena, next[0], next[1], next[2]);
+    if (!_arena_leaving(arena, cell)) continue;
+    if (_arena_contested(arena, i, next)) {
+      risky = dir;
+      continue;
+    }
+
+    if (arena->grid[cell] == ARENA_APPLE) apple = dir;
+    else if (dir == snake->dir) ahead = 1;
+    else turn = dir;
+  }
+
+  if (apple < 6) return INPUTS[apple];
+  if (ahead && (turn == 6 || _arena_rand(arena, 8))) return INPUT_OTHER;
+  if (turn < 6) return INPUTS[turn];
+  return risky < 6 ? INPUTS[risky] : INPUT_OTHER;
+}
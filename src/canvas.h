@@ -1,91 +1,368 @@
 #include <glad/glad.h>
 #include <cglm/cglm.h>
 #include <GLFW/glfw3.h>
+#include <pthread.h>
+#include <stddef.h>
+#include "types.h"
+#include "pack.h"
+#include "colors.h"
 
 #define UNI(shd, uni) (glGetUniformLocation(shd, uni))
 
-#define MIN(x, y) (x < y ? x : y)
-#define MAX(x, y) (x > y ? x : y)
-#define CLAMP(x, y, z) (MAX(MIN(z, y), x))
-#define CIRCULAR_CLAMP(x, y, z) ((y < x) ? z : ((y > z) ? x : y))
-#define RAND(min, max) (rand() % (max - min) + min)
-#define PRINT(...) { printf(__VA_ARGS__); printf("\n"); }
-#define ASSERT(x, ...) if (!(x)) { PRINT(__VA_ARGS__); exit(1); }
-#define VEC2_COPY(v1, v2) { v2[0] = v1[0]; v2[1] = v1[1]; }
-#define VEC2_COMPARE(v1, v2) (v1[0] == v2[0] && v1[1] == v2[1])
-#define VEC3_COPY(v1, v2) { v2[0] = v1[0]; v2[1] = v1[1]; v2[2] = v1[2]; }
-#define VEC3_ADD(v1, v2) { v1[0] += v2[0]; v1[1] += v2[1]; v1[2] += v2[2]; }
-#define VEC3_COMPARE(v1, v2) (v1[0] == v2[0] && v1[1] == v2[1] && v1[2] == v2[2])
 #define VERTEX_COPY(from, to) { for (u8 i_ = 0; i_ < 8; i_++) to[i_] = from[i_]; }
 #define VEC2(a, b)    (vec2) { a, b }
 #define VEC3(a, b, c) (vec3) { a, b, c }
-#define LEN(v) ( sizeof(v) / sizeof(v[0]) )
 
 #define PI  3.14159
 #define TAU PI * 2
 #define PI2 PI / 2
 #define PI4 PI / 4
 
-#define WHITE         { 1.00, 1.00, 1.00 }
-#define GRAY          { 0.50, 0.50, 0.50 }
-#define BLACK         { 0.00, 0.00, 0.00 }
-#define PURPLE        { 0.55, 0.41, 0.62 }
-#define PASTEL_BLUE   { 0.69, 0.87, 1.00 }
-#define PASTEL_PINK   { 1.00, 0.75, 0.79 }
-#define PASTEL_GREEN  { 0.60, 0.98, 0.60 }
-#define PASTEL_YELLOW { 1.00, 1.00, 0.60 }
-#define YELLOW        { 0.80, 0.80, 0.30 }
-#define PASTEL_PURPLE { 0.80, 0.70, 1.00 }
-#define DEEP_RED      { 0.60, 0.00, 0.00 }
-#define DEEP_BLUE     { 0.00, 0.00, 0.50 }
-#define DEEP_GREEN    { 0.00, 0.50, 0.00 }
-#define DEEP_PURPLE   { 0.40, 0.00, 0.60 }
-#define DEEP_ORANGE   { 1.00, 0.27, 0.00 }
-
-typedef uint8_t  u8;
-typedef uint16_t u16;
-typedef uint32_t u32;
-typedef int8_t   i8;
-typedef int16_t  i16;
-typedef int32_t  i32;
-typedef float    f32;
-typedef double   f64;
-typedef char     c8;
-
 u32 canvas_create_VAO();
 u32 canvas_create_VBO(u32, const void*, GLenum);
 void canvas_vertex_attrib_pointer(u8, u8, GLenum, GLenum, u16, void*);
+u32 canvas_create_FBO(u16, u16, GLenum, GLenum, u8);
+void canvas_delete_FBO(u32);
+
+// GL Stats
+
+// Define CANVAS_GL_STATS to count draws, uniform uploads, binds and program switches into gl_stats
+// The counting wraps glad's function pointers, so nothing else has to change to be accounted
+
+typedef struct {
+  u32 draws, uniforms, uploads, locations, buffer_binds, vao_binds, texture_binds, programs;
+} GLStats;
+
+GLStats gl_stats, gl_stats_last;
+FILE* gl_stats_file;
+
+#ifdef CANVAS_GL_STATS
+#define _GL_COUNT(counter, call, ...) (gl_stats.counter++, glad_##call(__VA_ARGS__))
+
+#undef glDrawArrays
+#undef glDrawArraysInstanced
+#undef glMultiDrawArrays
+#undef glDrawElements
+#undef glUniform1i
+#undef glUniform1f
+#undef glUniform2i
+#undef glUniform2f
+#undef glUniform3i
+#undef glUniform3f
+#undef glUniform4f
+#undef glUniformMatrix4fv
+#undef glBufferData
+#undef glBufferSubData
+#undef glGetUniformLocation
+#undef glBindBuffer
+#undef glBindVertexArray
+#undef glBindTexture
+#undef glUseProgram
+
+#define glDrawArrays(...)          _GL_COUNT(draws,         glDrawArrays,          __VA_ARGS__)
+#define glDrawArraysInstanced(...) _GL_COUNT(draws,         glDrawArraysInstanced, __VA_ARGS__)
+#define glMultiDrawArrays(...)     _GL_COUNT(draws,         glMultiDrawArrays,     __VA_ARGS__)
+#define glDrawElements(...)        _GL_COUNT(draws,         glDrawElements,        __VA_ARGS__)
+#define glUniform1i(...)           _GL_COUNT(uniforms,      glUniform1i,           __VA_ARGS__)
+#define glUniform1f(...)           _GL_COUNT(uniforms,      glUniform1f,           __VA_ARGS__)
+#define glUniform2i(...)           _GL_COUNT(uniforms,      glUniform2i,           __VA_ARGS__)
+#define glUniform2f(...)           _GL_COUNT(uniforms,      glUniform2f,           __VA_ARGS__)
+#define glUniform3i(...)           _GL_COUNT(uniforms,      glUniform3i,           __VA_ARGS__)
+#define glUniform3f(...)           _GL_COUNT(uniforms,      glUniform3f,           __VA_ARGS__)
+#define glUniform4f(...)           _GL_COUNT(uniforms,      glUniform4f,           __VA_ARGS__)
+#define glUniformMatrix4fv(...)    _GL_COUNT(uniforms,      glUniformMatrix4fv,    __VA_ARGS__)
+#define glBufferData(...)          _GL_COUNT(uploads,       glBufferData,          __VA_ARGS__)
+#define glBufferSubData(...)       _GL_COUNT(uploads,       glBufferSubData,       __VA_ARGS__)
+#define glGetUniformLocation(...)  _GL_COUNT(locations,     glGetUniformLocation,  __VA_ARGS__)
+#define glBindBuffer(...)          _GL_COUNT(buffer_binds,  glBindBuffer,          __VA_ARGS__)
+#define glBindVertexArray(...)     _GL_COUNT(vao_binds,     glBindVertexArray,     __VA_ARGS__)
+#define glBindTexture(...)         _GL_COUNT(texture_binds, glBindTexture,         __VA_ARGS__)
+#define glUseProgram(...)          _GL_COUNT(programs,      glUseProgram,          __VA_ARGS__)
+#endif
+
+void gl_stats_open(const c8* path) {
+  gl_stats_file = fopen(path, "w");
+  ASSERT(gl_stats_file, "Can't write GL stats (%s)", path);
+  fprintf(gl_stats_file, "draws,uniforms,uploads,locations,buffer_binds,vao_binds,texture_binds,programs\n");
+}
+
+// Closes the frame, its counts are kept in gl_stats_last and appended to the stats file
+void gl_stats_frame() {
+  gl_stats_last = gl_stats;
+  gl_stats = (GLStats) { 0 };
+
+  if (!gl_stats_file) return;
+  GLStats s = gl_stats_last;
+  fprintf(gl_stats_file, "%u,%u,%u,%u,%u,%u,%u,%u\n", s.draws, s.uniforms, s.uploads, s.locations, s.buffer_binds, s.vao_binds, s.texture_binds, s.programs);
+}
+
+// Prints every counter over its budget, returns whether all of them fit
+u8 gl_stats_check(GLStats stats, GLStats budget) {
+  u8 fits = 1;
+  #define _GL_BUDGET(counter) if (stats.counter > budget.counter) { PRINT("GL budget exceeded: %s %u > %u", #counter, stats.counter, budget.counter); fits = 0; }
+  _GL_BUDGET(draws);
+  _GL_BUDGET(uniforms);
+  _GL_BUDGET(uploads);
+  _GL_BUDGET(locations);
+  _GL_BUDGET(buffer_binds);
+  _GL_BUDGET(vao_binds);
+  _GL_BUDGET(texture_binds);
+  _GL_BUDGET(programs);
+  #undef _GL_BUDGET
+  return fits;
+}
+
+// Trace
+
+// Zones are recorded into a buffer owned by the calling thread, so recording needs no locks
+// Define CANVAS_TRACE to record them, otherwise every TRACE_* macro compiles to nothing
+
+#ifdef CANVAS_TRACE
+#include <stdatomic.h>
+#include <time.h>
+
+#define TRACE_CAPACITY (1 << 16)
+#define TRACE_THREADS  16
+#define TRACE_DEPTH    32
+
+typedef struct {
+  const c8* name;
+  u64 start, duration;
+} TraceEvent;
+
+typedef struct {
+  const c8* name;
+  u32 count, dropped, depth, open[TRACE_DEPTH];
+  TraceEvent events[TRACE_CAPACITY];
+} TraceBuffer;
+
+TraceBuffer* trace_buffers[TRACE_THREADS];
+atomic_uint trace_thread_count;
+_Thread_local TraceBuffer* trace_buffer;
+
+u64 _trace_now() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (u64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+TraceBuffer* _trace_thread_buffer() {
+  if (trace_buffer) return trace_buffer;
+
+  u32 slot = atomic_fetch_add(&trace_thread_count, 1);
+  ASSERT(slot < TRACE_THREADS, "Too many traced threads");
+  trace_buffer = calloc(1, sizeof(TraceBuffer));
+  trace_buffer->name = "thread";
+  trace_buffers[slot] = trace_buffer;
+  return trace_buffer;
+}
+
+void trace_thread(const c8* name) {
+  _trace_thread_buffer()->name = name;
+}
+
+void trace_begin(const c8* name) {
+  TraceBuffer* buffer = _trace_thread_buffer();
+  u32 event = buffer->count < TRACE_CAPACITY ? buffer->count++ : UINT32_MAX;
+  if (event == UINT32_MAX) buffer->dropped++;
+  else buffer->events[event] = (TraceEvent) { name, _trace_now(), 0 };
+  if (buffer->depth < TRACE_DEPTH) buffer->open[buffer->depth] = event;
+  buffer->depth++;
+}
+
+void trace_end() {
+  TraceBuffer* buffer = _trace_thread_buffer();
+  if (!buffer->depth) return;
+  buffer->depth--;
+  if (buffer->depth >= TRACE_DEPTH) return;
+
+  u32 event = buffer->open[buffer->depth];
+  if (event != UINT32_MAX) buffer->events[event].duration = _trace_now() - buffer->events[event].start;
+}
+
+// Writes every thread's zones as Chrome trace JSON, open it in chrome://tracing or ui.perfetto.dev
+void trace_dump(const c8* path) {
+  FILE* file = fopen(path, "w");
+  ASSERT(file, "Can't write trace (%s)", path);
+
+  u32 threads = MIN(atomic_load(&trace_thread_count), TRACE_THREADS);
+  u64 epoch = UINT64_MAX;
+  for (u32 t = 0; t < threads; t++)
+    if (trace_buffers[t] && trace_buffers[t]->count) epoch = MIN(epoch, trace_buffers[t]->events[0].start);
+
+  fprintf(file, "{\"traceEvents\":[\n");
+  u8 first = 1;
+  for (u32 t = 0; t < threads; t++) {
+    TraceBuffer* buffer = trace_buffers[t];
+    if (!buffer) continue;
+
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", t, buffer->name);
+    first = 0;
+
+    for (u32 i = 0; i < buffer->count; i++) {
+      TraceEvent* event = &buffer->events[i];
+      fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", event->name, t, (event->start - epoch) / 1e3, event->duration / 1e3);
+    }
+
+    if (buffer->dropped) PRINT("Trace buffer of %s dropped %u zones", buffer->name, buffer->dropped);
+  }
+  fprintf(file, "\n]}\n");
+  fclose(file);
+}
+
+#define TRACE_BEGIN(name)  trace_begin(name)
+#define TRACE_END()        trace_end()
+#define TRACE_THREAD(name) trace_thread(name)
+#define TRACE_DUMP(path)   trace_dump(path)
+#else
+#define TRACE_BEGIN(name)
+#define TRACE_END()
+#define TRACE_THREAD(name)
+#define TRACE_DUMP(path)
+#endif
+
+// Jobs
+
+// A few worker threads run jobs pushed from any thread, they only fill memory since the GL context
+// belongs to the main thread, where jobs_finish calls each job's finish as soon as its run is done
+
+#define JOB_WORKERS 4
+#define JOB_MAX     64
+
+typedef void (*JobFn)(void* data);
+
+typedef struct {
+  JobFn run, finish;
+  void* data;
+} Job;
+
+typedef struct {
+  Job jobs[JOB_MAX];
+  u32 count, next, done[JOB_MAX], done_count, collected;
+  pthread_mutex_t lock;
+  pthread_cond_t work, finished;
+  pthread_t workers[JOB_WORKERS];
+  u8 quit;
+} Jobs;
+
+void* _jobs_worker(void* data) {
+  Jobs* jobs = data;
+  TRACE_THREAD("worker");
+
+  pthread_mutex_lock(&jobs->lock);
+  while (1) {
+    while (jobs->next == jobs->count && !jobs->quit) pthread_cond_wait(&jobs->work, &jobs->lock);
+    if (jobs->next == jobs->count) break;
+
+    u32 i = jobs->next++;
+    pthread_mutex_unlock(&jobs->lock);
+    jobs->jobs[i].run(jobs->jobs[i].data);
+    pthread_mutex_lock(&jobs->lock);
+
+    jobs->done[jobs->done_count++] = i;
+    pthread_cond_signal(&jobs->finished);
+  }
+  pthread_mutex_unlock(&jobs->lock);
+  return NULL;
+}
+
+void jobs_start(Jobs* jobs) {
+  *jobs = (Jobs) { 0 };
+  pthread_mutex_init(&jobs->lock, NULL);
+  pthread_cond_init(&jobs->work, NULL);
+  pthread_cond_init(&jobs->finished, NULL);
+  for (u8 i = 0; i < JOB_WORKERS; i++) pthread_create(&jobs->workers[i], NULL, _jobs_worker, jobs);
+}
+
+// run is called on a worker, finish (if any) on the thread calling jobs_finish
+void jobs_push(Jobs* jobs, JobFn run, JobFn finish, void* data) {
+  pthread_mutex_lock(&jobs->lock);
+  ASSERT(jobs->count < JOB_MAX, "Too many jobs");
+  jobs->jobs[jobs->count++] = (Job) { run, finish, data };
+  pthread_cond_signal(&jobs->work);
+  pthread_mutex_unlock(&jobs->lock);
+}
+
+// Finishes jobs in the order their runs complete until none are left, jobs may push more while running
+void jobs_finish(Jobs* jobs) {
+  TRACE_BEGIN("jobs_finish");
+  pthread_mutex_lock(&jobs->lock);
+  while (jobs->collected < jobs->count) {
+    while (jobs->collected == jobs->done_count) pthread_cond_wait(&jobs->finished, &jobs->lock);
+
+    Job job = jobs->jobs[jobs->done[jobs->collected++]];
+    pthread_mutex_unlock(&jobs->lock);
+    if (job.finish) job.finish(job.data);
+    pthread_mutex_lock(&jobs->lock);
+  }
+  pthread_mutex_unlock(&jobs->lock);
+  TRACE_END();
+}
+
+void jobs_stop(Jobs* jobs) {
+  pthread_mutex_lock(&jobs->lock);
+  jobs->quit = 1;
+  pthread_cond_broadcast(&jobs->work);
+  pthread_mutex_unlock(&jobs->lock);
+  for (u8 i = 0; i < JOB_WORKERS; i++) pthread_join(jobs->workers[i], NULL);
+}
 
 // Canvas
 
+// refresh is the rate of the monitor swaps wait for under vsync, 0 when they don't wait
 typedef struct {
-  f32 fov, near_plane, far_plane, sensitivity, camera_lock, speed, pitch, yaw, fps;
+  f32 fov, near_plane, far_plane, sensitivity, camera_lock, speed, pitch, yaw, fps, refresh;
   vec3 pos, dir, rig;
   u16 width, height;
+  u32 FBO;
   GLFWwindow* window;
   mat4 view, proj, ortho;
 } Camera;
 
+// Headless draws into cam->FBO, sized width x height, instead of a window, which is also the
+// size used when there's no monitor to take it from
 typedef struct {
   char* title;
-  u8 capture_mouse, fullscreen;
-  f32 screen_size;
+  u8 capture_mouse, fullscreen, vsync, headless;
+  u16 width, height;
+  f32 screen_size, fps_cap, idle_fps;
   vec3 clear_color;
 } CanvasConfig;
 
 u32 PLANE_VAO, PLANE_VBO;
+const f32 PLANE_VERTEXES[6][5] = { { 0, 1, 0, 0, 0 }, { 0, 0, 0, 0, 1 }, { 1, 0, 0, 1, 1 }, { 1, 1, 0, 1, 0 }, { 0, 1, 0, 0, 0 }, { 1, 0, 0, 1, 1 } };
 
 void canvas_init(Camera* cam, CanvasConfig config) {
-  glfwInit();
+  TRACE_BEGIN("canvas_init");
+  // GLFW 3.4 can run without any display server, older ones still need one for the hidden window
+  #ifdef GLFW_PLATFORM_NULL
+  if (config.headless && glfwPlatformSupported(GLFW_PLATFORM_NULL)) glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+  #endif
+  ASSERT(glfwInit(), "Failed to init GLFW");
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-  const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
-  cam->width  = mode->width  * config.screen_size;
-  cam->height = mode->height * config.screen_size;
-  cam->window = glfwCreateWindow(cam->width, cam->height, config.title, config.fullscreen ? glfwGetPrimaryMonitor() : NULL, NULL);
+  GLFWmonitor* monitor = config.headless ? NULL : glfwGetPrimaryMonitor();
+  const GLFWvidmode* mode = monitor ? glfwGetVideoMode(monitor) : NULL;
+  cam->width  = mode ? mode->width  * config.screen_size : config.width;
+  cam->height = mode ? mode->height * config.screen_size : config.height;
+
+  // Headless contexts come from EGL (surfaceless on Mesa) or, failing that, OSMesa, both run on llvmpipe
+  if (config.headless) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+  }
+  cam->window = glfwCreateWindow(cam->width, cam->height, config.title, config.fullscreen ? monitor : NULL, NULL);
+  if (!cam->window && config.headless) {
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+    cam->window = glfwCreateWindow(cam->width, cam->height, config.title, NULL, NULL);
+  }
+  ASSERT(cam->window, "Failed to create a window");
+
   glfwMakeContextCurrent(cam->window);
+  glfwSwapInterval(config.headless ? 0 : config.vsync);
+  cam->refresh = !config.headless && config.vsync && mode ? mode->refreshRate : 0;
   gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_ALPHA_TEST);
@@ -111,11 +388,23 @@ void canvas_init(Camera* cam, CanvasConfig config) {
   glBindTexture(GL_TEXTURE_2D, tex_b);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_FLOAT, (f32[]) BLACK);
 
-  f32 square[6][5] =  { 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0, 1, 1, 1, 1, 0, 1, 0, 0, 1, 0, 0, 0, 1, 0, 0, 1, 1 };
   PLANE_VAO = canvas_create_VAO();
-  PLANE_VBO = canvas_create_VBO(30 * sizeof(f32), square, GL_STATIC_DRAW);
+  PLANE_VBO = canvas_create_VBO(sizeof(PLANE_VERTEXES), PLANE_VERTEXES, GL_STATIC_DRAW);
   canvas_vertex_attrib_pointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(f32), (void*) 0);
   canvas_vertex_attrib_pointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(f32), (void*) (3 * sizeof(f32)));
+
+  cam->FBO = config.headless ? canvas_create_FBO(cam->width, cam->height, GL_NEAREST, GL_NEAREST, 1) : 0;
+  glBindFramebuffer(GL_FRAMEBUFFER, cam->FBO);
+  TRACE_END();
+}
+
+// Only headless output can change size, the window keeps its own
+void canvas_resize(Camera* cam, u16 width, u16 height) {
+  ASSERT(cam->FBO, "Only headless canvases can be resized");
+  canvas_delete_FBO(cam->FBO);
+  cam->width  = width;
+  cam->height = height;
+  cam->FBO = canvas_create_FBO(width, height, GL_NEAREST, GL_NEAREST, 1);
 }
 
 void generate_proj_mat(Camera* cam, u32 shader) {
@@ -143,8 +432,133 @@ void update_fps(Camera* cam) {
   tick = glfwGetTime();
 }
 
+// GPU Timer
+
+#define GPU_TIMER_LATENCY 4
+
+// Results are read GPU_TIMER_LATENCY frames late so the CPU never waits on them
+typedef struct {
+  c8* name;
+  u32 queries[GPU_TIMER_LATENCY];
+  u32 frame;
+  f32 ms;
+} GpuTimer;
+
+void gpu_timer_begin(GpuTimer* timer) {
+  if (!timer->queries[0]) glGenQueries(GPU_TIMER_LATENCY, timer->queries);
+  u32 query = timer->queries[timer->frame % GPU_TIMER_LATENCY];
+
+  if (timer->frame >= GPU_TIMER_LATENCY) {
+    i32 available;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      GLuint64 elapsed;
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+      timer->ms = elapsed / 1e6;
+    }
+  }
+
+  glBeginQuery(GL_TIME_ELAPSED, query);
+}
+
+void gpu_timer_end(GpuTimer* timer) {
+  glEndQuery(GL_TIME_ELAPSED);
+  timer->frame++;
+}
+
+// Frame pacing
+
+#define FRAME_HISTORY 128
+#define FRAME_SPIN    0.002
+
+typedef struct {
+  f64 last, times[FRAME_HISTORY];
+  u32 count;
+  f32 mean, jitter, worst;
+} FramePacer;
+
+// Waits until 1 / fps seconds passed since the last frame, 0 fps doesn't wait
+void canvas_pace_frame(FramePacer* pacer, f32 fps) {
+  if (fps > 0 && pacer->last) {
+    f64 deadline = pacer->last + 1.0 / fps;
+
+    // Sleep through most of the wait still handling events, spin the rest for precision
+    while (deadline - glfwGetTime() > FRAME_SPIN)
+      glfwWaitEventsTimeout(deadline - glfwGetTime() - FRAME_SPIN);
+    while (glfwGetTime() < deadline);
+  }
+
+  f64 now = glfwGetTime();
+  if (pacer->last) pacer->times[pacer->count++ % FRAME_HISTORY] = now - pacer->last;
+  pacer->last = now;
+
+  u32 amount = MIN(pacer->count, FRAME_HISTORY);
+  if (!amount) return;
+
+  f64 sum = 0, deviation = 0, worst = 0;
+  for (u32 i = 0; i < amount; i++) {
+    sum += pacer->times[i];
+    worst = MAX(worst, pacer->times[i]);
+  }
+  for (u32 i = 0; i < amount; i++)
+    deviation += (pacer->times[i] - sum / amount) * (pacer->times[i] - sum / amount);
+
+  pacer->mean   = sum / amount * 1000;
+  pacer->jitter = sqrt(deviation / amount) * 1000;
+  pacer->worst  = worst * 1000;
+}
+
+// Render Scale
+
+// Picks the scale the scene is rendered at from smoothed frame times, lowering it when they pass
+// SCALE_HIGH of the budget and raising it only once they drop under SCALE_LOW, the gap between both
+// and a cooldown after every change keep it from going back and forth
+
+#define SCALE_HIGH     0.90
+#define SCALE_LOW      0.60
+#define SCALE_STEP     0.05
+#define SCALE_COOLDOWN 30
+
+typedef struct {
+  f32 scale, min, max;
+  f32 budget_ms, ms;
+  u32 cooldown;
+} RenderScale;
+
+// Returns whether the scale changed
+u8 canvas_render_scale(RenderScale* scale, f32 frame_ms) {
+  scale->ms = scale->ms ? scale->ms + (frame_ms - scale->ms) * 0.1 : frame_ms;
+  if (scale->cooldown) {
+    scale->cooldown--;
+    return 0;
+  }
+
+  f32 last = scale->scale;
+  if      (scale->ms > scale->budget_ms * SCALE_HIGH) scale->scale = MAX(scale->scale - SCALE_STEP, scale->min);
+  else if (scale->ms < scale->budget_ms * SCALE_LOW)  scale->scale = MIN(scale->scale + SCALE_STEP, scale->max);
+  if (scale->scale == last) return 0;
+
+  scale->cooldown = SCALE_COOLDOWN;
+  return 1;
+}
+
 // Object
 
+// Binds made through canvas_use_program/canvas_bind_VAO are skipped when already current
+u32 bound_program, bound_VAO;
+
+void canvas_use_program(u32 program) {
+  if (bound_program == program) return;
+  glUseProgram(program);
+  bound_program = program;
+}
+
+void canvas_bind_VAO(u32 VAO) {
+  if (bound_VAO == VAO) return;
+  glBindVertexArray(VAO);
+  bound_VAO = VAO;
+}
+
 u32 canvas_create_VBO(u32 size, const void* data, GLenum usage) {
   u32 VBO;
   glGenBuffers(1, &VBO);
@@ -156,11 +570,11 @@ u32 canvas_create_VBO(u32 size, const void* data, GLenum usage) {
 u32 canvas_create_VAO() {
   u32 VAO;
   glGenVertexArrays(1, &VAO);
-  glBindVertexArray(VAO);
+  canvas_bind_VAO(VAO);
   return VAO;
 }
 
-u32 canvas_create_FBO(u16 width, u16 height, GLenum min, GLenum mag) {
+u32 canvas_create_FBO(u16 width, u16 height, GLenum min, GLenum mag, u8 depth) {
   u32 FBO;
   glGenFramebuffers(1, &FBO);
   glBindFramebuffer(GL_FRAMEBUFFER, FBO);
@@ -170,38 +584,393 @@ u32 canvas_create_FBO(u16 width, u16 height, GLenum min, GLenum mag) {
   glActiveTexture(GL_TEXTURE31);
   glBindTexture(GL_TEXTURE_2D, REN_TEX);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, min);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mag);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag);
   glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, REN_TEX, 0);
 
+  // Depth is never sampled, so a renderbuffer is enough
+  if (depth) {
+    u32 DEP_RBO;
+    glGenRenderbuffers(1, &DEP_RBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, DEP_RBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, DEP_RBO);
+  }
+
+  ASSERT(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Incomplete framebuffer (%ix%i)", width, height);
   return FBO;
 }
 
+// Deletes the FBO along with the texture and renderbuffer canvas_create_FBO attached to it
+void canvas_delete_FBO(u32 FBO) {
+  i32 texture = 0, depth = 0;
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &texture);
+  glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,  GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &depth);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  u32 names[] = { texture, depth, FBO };
+  if (texture) glDeleteTextures(1, &names[0]);
+  if (depth)   glDeleteRenderbuffers(1, &names[1]);
+  glDeleteFramebuffers(1, &names[2]);
+}
+
+void canvas_blit_FBO(u32 from, u32 to, u16 from_w, u16 from_h, u16 to_w, u16 to_h) {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, from);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, to);
+  glBlitFramebuffer(0, 0, from_w, from_h, 0, 0, to_w, to_h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+}
+
 void canvas_vertex_attrib_pointer(u8 location, u8 amount, GLenum type, GLenum normalize, u16 stride, void* offset) {
   glVertexAttribPointer(location, amount, type, normalize, stride, offset);
   glEnableVertexAttribArray(location);
 }
 
+// Stream Buffer
+
+// Per frame vertex data is written into one of STREAM_FRAMES regions of a single buffer and a fence closes
+// each frame, so the CPU only waits when it gets that many frames ahead of the GPU (counted as stalls)
+// With ARB_buffer_storage the buffer stays mapped, otherwise every allocation is mapped unsynchronized
+
+#define STREAM_FRAMES 3
+#define STREAM_SIZE   (256 * 1024)
+
+typedef struct {
+  u32 VBO, size, frame, offset;
+  u8* data;
+  GLsync fences[STREAM_FRAMES];
+  u32 stalls, bytes, frame_bytes;
+} StreamBuffer;
+
+StreamBuffer STREAM = { .size = STREAM_SIZE };
+
+u8 _stream_persistent() {
+  #ifdef GL_VERSION_4_4
+  if (GLAD_GL_VERSION_4_4) return 1;
+  #endif
+  #ifdef GL_ARB_buffer_storage
+  if (GLAD_GL_ARB_buffer_storage) return 1;
+  #endif
+  return 0;
+}
+
+void _stream_create(StreamBuffer* stream) {
+  glGenBuffers(1, &stream->VBO);
+  glBindBuffer(GL_ARRAY_BUFFER, stream->VBO);
+
+  #if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+  if (_stream_persistent()) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, STREAM_FRAMES * stream->size, NULL, flags);
+    stream->data = glMapBufferRange(GL_ARRAY_BUFFER, 0, STREAM_FRAMES * stream->size, flags);
+    return;
+  }
+  #endif
+
+  glBufferData(GL_ARRAY_BUFFER, STREAM_FRAMES * stream->size, NULL, GL_STREAM_DRAW);
+}
+
+// Hands out size bytes of the current region, offset is where they start in the buffer
+// Must be followed by canvas_stream_unmap before drawing from them
+void* canvas_stream_map(StreamBuffer* stream, u32 size, u32 align, u32* offset) {
+  if (!stream->VBO) _stream_create(stream);
+
+  u32 start = stream->frame * stream->size;
+  u32 at = (start + stream->offset + align - 1) / align * align;
+  ASSERT(at + size <= start + stream->size, "Stream buffer is out of space (%u bytes per frame)", stream->size);
+  stream->offset = at + size - start;
+  stream->bytes += size;
+  *offset = at;
+
+  if (stream->data) return stream->data + at;
+  glBindBuffer(GL_ARRAY_BUFFER, stream->VBO);
+  return glMapBufferRange(GL_ARRAY_BUFFER, at, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+void canvas_stream_unmap(StreamBuffer* stream) {
+  if (!stream->data) glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+
+// Closes the frame's region and moves on to the next one, waiting if the GPU still reads from it
+void canvas_stream_fence(StreamBuffer* stream) {
+  if (!stream->VBO) return;
+  stream->fences[stream->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  stream->frame = (stream->frame + 1) % STREAM_FRAMES;
+  stream->frame_bytes = stream->bytes;
+  stream->bytes = stream->offset = 0;
+
+  GLsync fence = stream->fences[stream->frame];
+  if (!fence) return;
+  if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+    stream->stalls++;
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+  }
+  glDeleteSync(fence);
+  stream->fences[stream->frame] = NULL;
+}
+
+// Capture
+
+// Frames are read into a ring of CAPTURE_PBOS pixel buffers and only mapped once their fence passed,
+// a few frames later, so reading back never stalls the pipeline. Mapped frames are copied into a queue
+// that a writer thread flips, converts and writes to disk. Frames are dropped (and counted) rather than
+// waited on when the ring or the queue is full. Paths ending in .y4m get Y4M (4:4:4), others raw RGB
+
+#define CAPTURE_PBOS  4
+#define CAPTURE_QUEUE 8
+
+typedef struct {
+  u16 width, height;
+  u32 size, PBOs[CAPTURE_PBOS], first, pending;
+  GLsync fences[CAPTURE_PBOS];
+  f64 issued[CAPTURE_PBOS];
+
+  FILE* file;
+  u8 y4m, quit;
+  u8* frames[CAPTURE_QUEUE];
+  f64 times[CAPTURE_QUEUE];
+  u32 queued, written;
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+
+  u32 captured, dropped;
+  f64 latency, worst_latency;
+} Capture;
+
+void _capture_write(Capture* capture, u8* frame, u8* row) {
+  if (capture->y4m) {
+    fprintf(capture->file, "FRAME\n");
+    for (u8 plane = 0; plane < 3; plane++)
+      for (i32 y = capture->height - 1; y >= 0; y--) {
+        u8* in = frame + y * capture->width * 4;
+        for (u32 x = 0; x < capture->width; x++, in += 4) {
+          f32 r = in[0], g = in[1], b = in[2];
+          row[x] = plane == 0 ?  16 + ( 65.738 * r + 129.057 * g +  25.064 * b) / 256
+                 : plane == 1 ? 128 + (-37.945 * r -  74.494 * g + 112.439 * b) / 256
+                 :              128 + (112.439 * r -  94.154 * g -  18.285 * b) / 256;
+        }
+        fwrite(row, 1, capture->width, capture->file);
+      }
+    return;
+  }
+
+  for (i32 y = capture->height - 1; y >= 0; y--) {
+    u8* in = frame + y * capture->width * 4;
+    for (u32 x = 0; x < capture->width; x++, in += 4) memcpy(&row[x * 3], in, 3);
+    fwrite(row, 1, capture->width * 3, capture->file);
+  }
+}
+
+void* _capture_writer(void* data) {
+  Capture* capture = data;
+  TRACE_THREAD("capture");
+  u8* row = malloc(capture->width * 3);
+
+  pthread_mutex_lock(&capture->lock);
+  while (1) {
+    while (capture->written == capture->queued && !capture->quit) pthread_cond_wait(&capture->wake, &capture->lock);
+    if (capture->written == capture->queued) break;
+
+    u32 slot = capture->written % CAPTURE_QUEUE;
+    pthread_mutex_unlock(&capture->lock);
+
+    TRACE_BEGIN("capture_write");
+    _capture_write(capture, capture->frames[slot], row);
+    TRACE_END();
+    f64 latency = (glfwGetTime() - capture->times[slot]) * 1000;
+
+    pthread_mutex_lock(&capture->lock);
+    capture->latency += (latency - capture->latency) * 0.1;
+    capture->worst_latency = MAX(capture->worst_latency, latency);
+    capture->captured++;
+    capture->written++;
+  }
+  pthread_mutex_unlock(&capture->lock);
+
+  free(row);
+  return NULL;
+}
+
+void canvas_capture_start(Capture* capture, const c8* path, u16 width, u16 height, u32 fps) {
+  *capture = (Capture) { .width = width, .height = height, .size = width * height * 4 };
+  capture->file = fopen(path, "wb");
+  ASSERT(capture->file, "Can't write capture (%s)", path);
+
+  u32 length = strlen(path);
+  capture->y4m = length > 4 && !strcmp(path + length - 4, ".y4m");
+  if (capture->y4m) fprintf(capture->file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", width, height, fps);
+
+  glGenBuffers(CAPTURE_PBOS, capture->PBOs);
+  for (u8 i = 0; i < CAPTURE_PBOS; i++) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->PBOs[i]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, capture->size, NULL, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  for (u8 i = 0; i < CAPTURE_QUEUE; i++) capture->frames[i] = malloc(capture->size);
+  pthread_mutex_init(&capture->lock, NULL);
+  pthread_cond_init(&capture->wake, NULL);
+  pthread_create(&capture->writer, NULL, _capture_writer, capture);
+}
+
+// Hands the oldest readback to the writer, waiting on its fence only when told to
+u8 _capture_collect(Capture* capture, u8 wait) {
+  if (!capture->pending) return 0;
+  u32 i = capture->first;
+
+  GLenum status = glClientWaitSync(capture->fences[i], wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000 : 0);
+  if (status == GL_TIMEOUT_EXPIRED) return 0;
+  glDeleteSync(capture->fences[i]);
+  capture->first = (i + 1) % CAPTURE_PBOS;
+  capture->pending--;
+
+  pthread_mutex_lock(&capture->lock);
+  u8 full = capture->queued - capture->written == CAPTURE_QUEUE;
+  pthread_mutex_unlock(&capture->lock);
+  if (full) {
+    capture->dropped++;
+    return 1;
+  }
+
+  // Only the writer moves written, so the slot stays free until queued is published
+  u32 slot = capture->queued % CAPTURE_QUEUE;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->PBOs[i]);
+  void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, capture->size, GL_MAP_READ_BIT);
+  memcpy(capture->frames[slot], pixels, capture->size);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  pthread_mutex_lock(&capture->lock);
+  capture->times[slot] = capture->issued[i];
+  capture->queued++;
+  pthread_cond_signal(&capture->wake);
+  pthread_mutex_unlock(&capture->lock);
+  return 1;
+}
+
+// Starts reading back the capture-sized corner of FBO and collects the readbacks that are done
+void canvas_capture_frame(Capture* capture, u32 FBO) {
+  TRACE_BEGIN("capture_frame");
+  while (_capture_collect(capture, 0));
+
+  if (capture->pending == CAPTURE_PBOS) capture->dropped++;
+  else {
+    u32 i = (capture->first + capture->pending++) % CAPTURE_PBOS;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->PBOs[i]);
+    glReadPixels(0, 0, capture->width, capture->height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    capture->fences[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    capture->issued[i] = glfwGetTime();
+  }
+  TRACE_END();
+}
+
+// Copies what the writer thread counts, under its lock since it keeps updating them
+void canvas_capture_stats(Capture* capture, u32* captured, f64* latency) {
+  pthread_mutex_lock(&capture->lock);
+  *captured = capture->captured;
+  *latency = capture->latency;
+  pthread_mutex_unlock(&capture->lock);
+}
+
+// Writes out every frame still in flight, then closes the file
+void canvas_capture_stop(Capture* capture) {
+  while (_capture_collect(capture, 1));
+
+  pthread_mutex_lock(&capture->lock);
+  capture->quit = 1;
+  pthread_cond_signal(&capture->wake);
+  pthread_mutex_unlock(&capture->lock);
+  pthread_join(capture->writer, NULL);
+
+  fclose(capture->file);
+  glDeleteBuffers(CAPTURE_PBOS, capture->PBOs);
+  for (u8 i = 0; i < CAPTURE_QUEUE; i++) free(capture->frames[i]);
+}
+
+// Uniform Blocks
+
+// Mirrors of the std140 blocks in obj.f, lights and the current material are uploaded whole
+// with a single glBufferSubData when they change instead of one glUniform per field
+
+#define LIGHT_MAX      10
+#define BLOCK_LIGHTS   0
+#define BLOCK_MATERIAL 1
+
+typedef struct { f32 col[3], _0, dir[3], _1; } _DirLigStd140;
+typedef struct { f32 col[3], _0, pos[3], con, lin, qua, _1[2]; } _PntLigStd140;
+typedef struct { f32 col[3], _0, pos[3], _1, dir[3], con, lin, qua, inn, out; } _SptLigStd140;
+
+typedef struct {
+  _DirLigStd140 dir[LIGHT_MAX];
+  _PntLigStd140 pnt[LIGHT_MAX];
+  _SptLigStd140 spt[LIGHT_MAX];
+  i32 dir_amount, pnt_amount, spt_amount, _0;
+} LightBlock;
+
+typedef struct {
+  f32 col[3], amb, dif;
+  i32 lig;
+  f32 grd, org;
+} MaterialBlock;
+
+_Static_assert(sizeof(_DirLigStd140) == 32 && sizeof(_PntLigStd140) == 48 && sizeof(_SptLigStd140) == 64, "Light structs don't match std140");
+_Static_assert(sizeof(LightBlock) == 1456 && sizeof(MaterialBlock) == 32, "Blocks don't match std140");
+
+u32 LIGHT_UBO, MATERIAL_UBO, bound_UBO;
+LightBlock light_block;
+u8 light_block_dirty;
+
+void canvas_bind_UBO(u32 UBO) {
+  if (bound_UBO == UBO) return;
+  glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+  bound_UBO = UBO;
+}
+
+u32 canvas_create_UBO(u8 binding, u32 size, const void* data) {
+  u32 UBO;
+  glGenBuffers(1, &UBO);
+  canvas_bind_UBO(UBO);
+  glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, binding, UBO);
+  return UBO;
+}
+
+void _shader_bind_blocks(u32 program) {
+  if (!LIGHT_UBO) {
+    LIGHT_UBO    = canvas_create_UBO(BLOCK_LIGHTS,   sizeof(LightBlock),    &light_block);
+    MATERIAL_UBO = canvas_create_UBO(BLOCK_MATERIAL, sizeof(MaterialBlock), NULL);
+  }
+
+  u32 lights   = glGetUniformBlockIndex(program, "LightBlock");
+  u32 material = glGetUniformBlockIndex(program, "MaterialBlock");
+  if (lights   != GL_INVALID_INDEX) glUniformBlockBinding(program, lights,   BLOCK_LIGHTS);
+  if (material != GL_INVALID_INDEX) glUniformBlockBinding(program, material, BLOCK_MATERIAL);
+}
+
+// Uploads the lights set since the last flush, called before drawing
+void canvas_flush_lights() {
+  if (!light_block_dirty) return;
+  canvas_bind_UBO(LIGHT_UBO);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightBlock), &light_block);
+  light_block_dirty = 0;
+}
+
 // Shader
 
 u32 _create_shader(GLenum type, char path[]) {
-  FILE* file = fopen(path, "r");
-  ASSERT(file, "Can't open shader (%s)", path);
+  Asset source = asset_load(path);
+  ASSERT(source.data, "Can't open shader (%s)", path);
   i32 success;
 
-  fseek(file, 0, SEEK_END);
-  int size = ftell(file);
-  rewind(file);
-
-  char shader_source[size];
-  fread(shader_source, sizeof(char), size - 1, file);
-  shader_source[size - 1] = '\0';
-  fclose(file);
-
   u32 shader = glCreateShader(type);
-  const char* _shader_source = shader_source;
-  glShaderSource(shader, 1, &_shader_source, NULL);
+  const char* _shader_source = (const char*) source.data;
+  i32 size = source.size;
+  glShaderSource(shader, 1, &_shader_source, &size);
   glCompileShader(shader);
+  asset_free(&source);
 
   glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
   ASSERT(success, "Error compiling shader (%s)", path);
@@ -209,6 +978,7 @@ u32 _create_shader(GLenum type, char path[]) {
 }
 
 u32 shader_create_program(char name[]) {
+  TRACE_BEGIN("shader_create_program");
   c8 vertex_path[64] = { 0 };
   sprintf(vertex_path, "shd/%s.v", name);
   u32 v_shader = _create_shader(GL_VERTEX_SHADER, vertex_path);
@@ -228,7 +998,9 @@ u32 shader_create_program(char name[]) {
   glGetProgramiv(shader_program, GL_LINK_STATUS, &success);
   ASSERT(success, "Error linking shaders");
 
-  glUseProgram(shader_program);
+  _shader_bind_blocks(shader_program);
+  canvas_use_program(shader_program);
+  TRACE_END();
   return shader_program;
 }
 
@@ -251,7 +1023,8 @@ u32 shader_create_program_raw(const char* v_shader_source, const char* f_shader_
   glGetProgramiv(shader_program, GL_LINK_STATUS, &success);
   ASSERT(success, "Error linking shaders");
 
-  glUseProgram(shader_program);
+  _shader_bind_blocks(shader_program);
+  canvas_use_program(shader_program);
   return shader_program;
 }
 
@@ -271,52 +1044,84 @@ typedef struct {
   GLenum wrap_s, wrap_t, min_filter, mag_filter;
 } TextureConfig;
 
-u32 canvas_create_texture(GLenum unit, char* name, TextureConfig config) {
-  c8 path[64] = { 0 };
-  sprintf(path, "img/%s.ppm", name);
+typedef struct {
+  c8 path[64];
+  GLenum unit;
+  TextureConfig config;
+  u16 width, height;
+  f32* pixels;
+  u32 texture;
+} TextureLoad;
 
-  FILE* img = fopen(path, "r");
-  ASSERT(img, "Can't open image (%s)", path);
+void _texture_parse(void* data) {
+  TRACE_BEGIN("texture_parse");
+  TextureLoad* load = data;
+  Asset img = asset_load(load->path);
+  ASSERT(img.data, "Can't open image (%s)", load->path);
 
   u16 ppm, width, height, maxval;
-  fscanf(img, "P%hi %hi %hi %hi", &ppm, &width, &height, &maxval);
+  i32 header = 0;
+  sscanf((const c8*) img.data, "P%hi %hi %hi %hi%n", &ppm, &width, &height, &maxval, &header);
+  ASSERT(header, "Bad image header (%s)", load->path);
 
   f32* buffer = malloc(sizeof(f32) * width * height * 3);
-  f32 _temp[3];
-  u8   temp[3];
 
   if (ppm == 3) {
-    for (u32 i = 0; i < width * height * 3; i += 3) {
-      fscanf(img, "%f %f %f", &buffer[i], &buffer[i + 1], &buffer[i + 2]);
-      glm_vec3_scale(&buffer[i], (f32) 1 / maxval, &buffer[i]);
-    }
+    c8* text = (c8*) img.data + header;
+    for (u32 i = 0; i < width * height * 3; i++)
+      buffer[i] = strtof(text, &text) / maxval;
   }
 
+  // A single whitespace separates the header from the binary samples, 2 bytes each past 255
   if (ppm == 6) {
-    img = fopen(path, "rb");
-    fscanf(img, "P%*d %*d %*d %*d\n");
-    for (u32 i = 0; i < width * height * 3; i += 3) {
-      fread(temp, 1 + (maxval > 255), 3, img);
-      VEC3_COPY(temp, _temp);
-      glm_vec3_scale(_temp, (f32) 1 / maxval, &buffer[i]);
-    }
+    const u8* samples = img.data + header + 1;
+    u8 wide = maxval > 255;
+    ASSERT(header + 1 + width * height * 3 * (1 + wide) <= img.size, "Truncated image (%s)", load->path);
+    for (u32 i = 0; i < width * height * 3; i++)
+      buffer[i] = (f32) (wide ? samples[i * 2] << 8 | samples[i * 2 + 1] : samples[i]) / maxval;
   }
 
-  fclose(img);
+  asset_free(&img);
+  load->width  = width;
+  load->height = height;
+  load->pixels = buffer;
+  TRACE_END();
+}
 
-  u32 texture;
-  glGenTextures(1, &texture);
-  glActiveTexture(unit);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,     config.wrap_s);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,     config.wrap_t);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, config.min_filter);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, config.mag_filter);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_FLOAT, buffer);
+void _texture_upload(TextureLoad* load) {
+  TRACE_BEGIN("texture_upload");
+  glGenTextures(1, &load->texture);
+  glActiveTexture(load->unit);
+  glBindTexture(GL_TEXTURE_2D, load->texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,     load->config.wrap_s);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,     load->config.wrap_t);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, load->config.min_filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, load->config.mag_filter);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, load->width, load->height, 0, GL_RGB, GL_FLOAT, load->pixels);
   glGenerateMipmap(GL_TEXTURE_2D);
+  free(load->pixels);
+  TRACE_END();
+}
+
+void _texture_finish(void* data) {
+  _texture_upload(data);
+  free(data);
+}
+
+u32 canvas_create_texture(GLenum unit, char* name, TextureConfig config) {
+  TextureLoad load = { .unit = unit, .config = config };
+  sprintf(load.path, "img/%s.ppm", name);
+  _texture_parse(&load);
+  _texture_upload(&load);
+  return load.texture;
+}
 
-  free(buffer);
-  return texture;
+// Decodes the image on a worker, it's uploaded to unit when jobs_finish gets to it
+void canvas_load_texture(Jobs* jobs, GLenum unit, char* name, TextureConfig config) {
+  TextureLoad* load = malloc(sizeof(TextureLoad));
+  *load = (TextureLoad) { .unit = unit, .config = config };
+  sprintf(load->path, "img/%s.ppm", name);
+  jobs_push(jobs, _texture_parse, _texture_finish, load);
 }
 
 // Material
@@ -326,15 +1131,47 @@ typedef struct {
   f64  amb, dif;
   GLenum tex, emt;
   u8 lig;
+  f32 grd, org;
 } Material;
 
+// Last material set, the block is shared by every program but samplers are per program
+// Anything setting S_DIF/S_EMT directly must call canvas_forget_material
+Material bound_material;
+MaterialBlock bound_material_block;
+u32 bound_material_shader;
+u8 bound_material_valid;
+
+void canvas_forget_material() {
+  bound_material_shader = 0;
+}
+
 void canvas_set_material(u32 shader, Material mat) {
-  canvas_uni3f(shader, "MAT.COL", mat.col[0], mat.col[1], mat.col[2]);
-  canvas_uni1f(shader, "MAT.AMB", mat.amb);
-  canvas_uni1f(shader, "MAT.DIF", mat.dif);
-  canvas_uni1i(shader, "MAT.S_DIF", mat.tex >= GL_TEXTURE0 ? (mat.tex - GL_TEXTURE0) : 29);
-  canvas_uni1i(shader, "MAT.S_EMT", mat.emt >= GL_TEXTURE0 ? (mat.emt - GL_TEXTURE0) : 30);
-  canvas_uni1i(shader, "MAT.LIG", mat.lig);
+  MaterialBlock block = { { mat.col[0], mat.col[1], mat.col[2] }, mat.amb, mat.dif, mat.lig, mat.grd, mat.org };
+  if (!bound_material_valid || memcmp(&block, &bound_material_block, sizeof(MaterialBlock))) {
+    canvas_bind_UBO(MATERIAL_UBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(MaterialBlock), &block);
+    bound_material_block = block;
+    bound_material_valid = 1;
+  }
+
+  u8 all = bound_material_shader != shader;
+  if (all || mat.tex != bound_material.tex) canvas_uni1i(shader, "S_DIF", mat.tex >= GL_TEXTURE0 ? (mat.tex - GL_TEXTURE0) : 29);
+  if (all || mat.emt != bound_material.emt) canvas_uni1i(shader, "S_EMT", mat.emt >= GL_TEXTURE0 ? (mat.emt - GL_TEXTURE0) : 30);
+
+  bound_material = mat;
+  bound_material_shader = shader;
+}
+
+i32 _material_compare(Material* a, Material* b) {
+  for (u8 i = 0; i < 3; i++)
+    if (a->col[i] != b->col[i]) return a->col[i] < b->col[i] ? -1 : 1;
+  if (a->amb != b->amb) return a->amb < b->amb ? -1 : 1;
+  if (a->dif != b->dif) return a->dif < b->dif ? -1 : 1;
+  if (a->tex != b->tex) return a->tex < b->tex ? -1 : 1;
+  if (a->emt != b->emt) return a->emt < b->emt ? -1 : 1;
+  if (a->grd != b->grd) return a->grd < b->grd ? -1 : 1;
+  if (a->org != b->org) return a->org < b->org ? -1 : 1;
+  return (a->lig > b->lig) - (a->lig < b->lig);
 }
 
 // Model
@@ -357,9 +1194,20 @@ void model_parse(Model* model, const c8* path, u32* size, f32 scale) {
   u32 tex_i = 0;
   u32 vrt_i = 0;
 
-  FILE* file = fopen(path, "r");
+  Asset file = asset_load(path);
+  ASSERT(file.data, "Can't open model (%s)", path);
+  const c8* line = (const c8*) file.data;
+  const c8* end  = line + file.size;
+
   c8 buffer[256];
-  while (fgets(buffer, 256, file)) {
+  while (line < end) {
+    const c8* next = memchr(line, '\n', end - line);
+    next = next ? next + 1 : end;
+    u32 length = MIN(next - line, 255);
+    memcpy(buffer, line, length);
+    buffer[length] = 0;
+    line = next;
+
     if      (buffer[0] == 'v' && buffer[1] == ' ') {
       poss = realloc(poss, sizeof(vec3) * (++pos_i + 1));
       sscanf(buffer, "v %f %f %f", &poss[pos_i][0], &poss[pos_i][1], &poss[pos_i][2]);
@@ -399,7 +1247,7 @@ void model_parse(Model* model, const c8* path, u32* size, f32 scale) {
     }
   }
 
-  fclose(file);
+  asset_free(&file);
   free(poss);
   free(texs);
 
@@ -407,35 +1255,250 @@ void model_parse(Model* model, const c8* path, u32* size, f32 scale) {
   model->vertexes = square;
 }
 
+void _model_upload(Model* model) {
+  model->VAO = canvas_create_VAO();
+  model->VBO = canvas_create_VBO(model->size * sizeof(Vertex), model->vertexes, GL_STATIC_DRAW);
+  canvas_vertex_attrib_pointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(f32), (void*) 0);
+  canvas_vertex_attrib_pointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(f32), (void*) (3 * sizeof(f32)));
+  canvas_vertex_attrib_pointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(f32), (void*) (6 * sizeof(f32)));
+}
+
 Model* model_create(const c8* name, Material* material, f32 scale) {
+  TRACE_BEGIN("model_create");
   c8 buffer[64] = { 0 };
   sprintf(buffer, "obj/%s.obj", name);
 
   Model* model = malloc(sizeof(Model));
   model_parse(model, buffer, &model->size, scale);
   model->material = material;
+  _model_upload(model);
 
-  model->VAO = canvas_create_VAO();
-  model->VBO = canvas_create_VBO(model->size * sizeof(Vertex), model->vertexes, GL_STATIC_DRAW);
-  canvas_vertex_attrib_pointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(f32), (void*) 0);
-  canvas_vertex_attrib_pointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(f32), (void*) (3 * sizeof(f32)));
-  canvas_vertex_attrib_pointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(f32), (void*) (6 * sizeof(f32)));
+  TRACE_END();
+  return model;
+}
+
+typedef struct {
+  Model* model;
+  c8 path[64];
+  f32 scale;
+} ModelLoad;
+
+void _model_parse_job(void* data) {
+  TRACE_BEGIN("model_parse");
+  ModelLoad* load = data;
+  model_parse(load->model, load->path, &load->model->size, load->scale);
+  TRACE_END();
+}
+
+void _model_finish(void* data) {
+  ModelLoad* load = data;
+  _model_upload(load->model);
+  free(load);
+}
+
+// Parses on a worker, the model can't be drawn before jobs_finish uploaded it
+Model* model_load(Jobs* jobs, const c8* name, Material* material, f32 scale) {
+  Model* model = calloc(1, sizeof(Model));
+  model->material = material;
 
+  ModelLoad* load = malloc(sizeof(ModelLoad));
+  *load = (ModelLoad) { model, .scale = scale };
+  sprintf(load->path, "obj/%s.obj", name);
+  jobs_push(jobs, _model_parse_job, _model_finish, load);
   return model;
 }
 
+// Another model drawing the same buffers with its own material
+Model* model_share(Model* model, Material* material) {
+  Model* shared = malloc(sizeof(Model));
+  *shared = *model;
+  shared->material = material;
+  return shared;
+}
+
 void model_bind(Model* model, u32 shader) {
   if (model->material != NULL) canvas_set_material(shader, *model->material);
   glm_mat4_identity(model->model);
 }
 
 void model_draw(Model* model, u32 shader) {
-  glBindBuffer(GL_ARRAY_BUFFER, model->VBO);
-  glBindVertexArray(model->VAO);
+  canvas_flush_lights();
+  canvas_bind_VAO(model->VAO);
   canvas_unim4(shader, "MODEL", model->model[0]);
   glDrawArrays(GL_TRIANGLES, 0, model->size);
 }
 
+// Draws one instance per vec3 written at offset in the stream, each is added to the world position
+void model_draw_instanced(Model* model, u32 shader, StreamBuffer* stream, u32 offset, u32 instances) {
+  canvas_flush_lights();
+  canvas_bind_VAO(model->VAO);
+  canvas_unim4(shader, "MODEL", model->model[0]);
+
+  glBindBuffer(GL_ARRAY_BUFFER, stream->VBO);
+  canvas_vertex_attrib_pointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*) (u64) offset);
+  glVertexAttribDivisor(4, 1);
+  glDrawArraysInstanced(GL_TRIANGLES, 0, model->size, instances);
+  glDisableVertexAttribArray(4);
+}
+
+// An instance as 12 bytes instead of a vec3 and a color: a whole cell position and a tint the
+// shader mixes into the material color by 1 - alpha, so an alpha of 0 is the tint alone
+typedef struct {
+  u16 offset[3], pad;
+  u8 color[4];
+} TintedInstance;
+
+// Same as model_draw_instanced with TintedInstance, the tint goes back to none for the draws after
+void model_draw_tinted(Model* model, u32 shader, StreamBuffer* stream, u32 offset, u32 instances) {
+  canvas_flush_lights();
+  canvas_bind_VAO(model->VAO);
+  canvas_unim4(shader, "MODEL", model->model[0]);
+
+  glBindBuffer(GL_ARRAY_BUFFER, stream->VBO);
+  canvas_vertex_attrib_pointer(4, 3, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(TintedInstance), (void*) (u64) offset);
+  canvas_vertex_attrib_pointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TintedInstance), (void*) (u64) (offset + offsetof(TintedInstance, color)));
+  glVertexAttribDivisor(4, 1);
+  glVertexAttribDivisor(5, 1);
+  glDrawArraysInstanced(GL_TRIANGLES, 0, model->size, instances);
+  glDisableVertexAttribArray(4);
+  glDisableVertexAttribArray(5);
+  glVertexAttrib4f(5, 0, 0, 0, 1);
+}
+
+// Render Queue
+
+// Draws are collected during the frame and sorted by program, mesh and material before being submitted,
+// so consecutive commands share as much state as possible and the redundant binds are skipped
+
+typedef struct {
+  u32 shader, order, first, count, draws;
+  i32 *firsts, *counts;
+  Model* model;
+  Material material;
+  mat4 transform;
+} RenderCommand;
+
+typedef struct {
+  RenderCommand* commands;
+  u32 size, capacity;
+} RenderQueue;
+
+// Queues count vertexes of the model starting at first
+void render_queue_push_range(RenderQueue* queue, u32 shader, Model* model, Material material, mat4 transform, u32 first, u32 count) {
+  if (queue->size == queue->capacity) {
+    queue->capacity = MAX(queue->capacity * 2, 64);
+    queue->commands = realloc(queue->commands, queue->capacity * sizeof(RenderCommand));
+  }
+
+  RenderCommand* command = &queue->commands[queue->size];
+  command->shader   = shader;
+  command->order    = queue->size++;
+  command->first    = first;
+  command->count    = count;
+  command->firsts   = NULL;
+  command->model    = model;
+  command->material = material;
+  glm_mat4_copy(transform, command->transform);
+}
+
+// Queues several ranges of the model as a single glMultiDrawArrays, the arrays must outlive the submit
+void render_queue_push_multi(RenderQueue* queue, u32 shader, Model* model, Material material, mat4 transform, i32* firsts, i32* counts, u32 draws) {
+  render_queue_push_range(queue, shader, model, material, transform, 0, 0);
+  RenderCommand* command = &queue->commands[queue->size - 1];
+  command->firsts = firsts;
+  command->counts = counts;
+  command->draws  = draws;
+}
+
+void render_queue_push(RenderQueue* queue, u32 shader, Model* model, Material material, mat4 transform) {
+  render_queue_push_range(queue, shader, model, material, transform, 0, model->size);
+}
+
+i32 _render_command_compare(const void* a, const void* b) {
+  RenderCommand* x = (RenderCommand*) a;
+  RenderCommand* y = (RenderCommand*) b;
+  if (x->shader != y->shader)           return x->shader < y->shader ? -1 : 1;
+  if (x->model->VAO != y->model->VAO)   return x->model->VAO < y->model->VAO ? -1 : 1;
+  i32 material = _material_compare(&x->material, &y->material);
+  if (material) return material;
+  return x->order < y->order ? -1 : 1;
+}
+
+void render_queue_submit(RenderQueue* queue) {
+  canvas_flush_lights();
+  qsort(queue->commands, queue->size, sizeof(RenderCommand), _render_command_compare);
+
+  for (u32 i = 0; i < queue->size; i++) {
+    RenderCommand* command = &queue->commands[i];
+    canvas_use_program(command->shader);
+    canvas_set_material(command->shader, command->material);
+    canvas_bind_VAO(command->model->VAO);
+    canvas_unim4(command->shader, "MODEL", command->transform[0]);
+    if (command->firsts) glMultiDrawArrays(GL_TRIANGLES, command->firsts, command->counts, command->draws);
+    else glDrawArrays(GL_TRIANGLES, command->first, command->count);
+  }
+
+  queue->size = 0;
+}
+
+// Culling
+
+// Boxes are kept as SoA so the planes are tested against four of them at once, a box is culled
+// as soon as the corner furthest along a plane's normal is still behind it
+
+#define CULL_MAX 64
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CANVAS_SSE
+#endif
+
+typedef struct {
+  f32 min[3][CULL_MAX], max[3][CULL_MAX];
+  u32 size;
+} CullBoxes;
+
+void canvas_frustum_planes(Camera* cam, vec4 planes[6]) {
+  mat4 view_proj;
+  glm_mat4_mul(cam->proj, cam->view, view_proj);
+  glm_frustum_planes(view_proj, planes);
+}
+
+// Sets visible for each of the boxes, returns how many are
+u32 canvas_cull_boxes(vec4 planes[6], CullBoxes* boxes, u8* visible) {
+  u32 amount = 0;
+
+  for (u32 i = 0; i < boxes->size; i += 4) {
+    #ifdef CANVAS_SSE
+    __m128 outside = _mm_setzero_ps();
+    for (u8 p = 0; p < 6; p++) {
+      __m128 x = _mm_loadu_ps(&(planes[p][0] >= 0 ? boxes->max : boxes->min)[0][i]);
+      __m128 y = _mm_loadu_ps(&(planes[p][1] >= 0 ? boxes->max : boxes->min)[1][i]);
+      __m128 z = _mm_loadu_ps(&(planes[p][2] >= 0 ? boxes->max : boxes->min)[2][i]);
+      __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes[p][0])), _mm_mul_ps(y, _mm_set1_ps(planes[p][1]))),
+                                   _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(planes[p][2])), _mm_set1_ps(planes[p][3])));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_setzero_ps()));
+    }
+    u8 culled = _mm_movemask_ps(outside);
+    #else
+    u8 culled = 0;
+    for (u8 j = 0; j < 4 && i + j < boxes->size; j++)
+      for (u8 p = 0; p < 6; p++) {
+        f32 distance = planes[p][3];
+        for (u8 a = 0; a < 3; a++) distance += planes[p][a] * (planes[p][a] >= 0 ? boxes->max : boxes->min)[a][i + j];
+        if (distance < 0) { culled |= 1 << j; break; }
+      }
+    #endif
+
+    for (u8 j = 0; j < 4 && i + j < boxes->size; j++) {
+      visible[i + j] = !(culled >> j & 1);
+      amount += visible[i + j];
+    }
+  }
+
+  return amount;
+}
+
 // Light
 
 typedef struct {
@@ -452,78 +1515,60 @@ typedef struct {
   f32  con, lin, qua, inn, out;
 } SptLig;
 
-void canvas_set_dir_lig(u32 shader, DirLig dir_lig, u32 i) {
-  canvas_uni1i(shader, "DIR_LIG_AMOUNT", i + 1);
-  char uniform[255];
-  sprintf(uniform, "DIR_LIGS[%i].COL", i);
-  canvas_uni3f(shader, uniform, dir_lig.col[0], dir_lig.col[1], dir_lig.col[2]);
-  sprintf(uniform, "DIR_LIGS[%i].DIR", i);
-  canvas_uni3f(shader, uniform, dir_lig.dir[0], dir_lig.dir[1], dir_lig.dir[2]);
-}
-
-void canvas_set_pnt_lig(u32 shader, PntLig pnt_lig, u32 i) {
-  canvas_uni1i(shader, "PNT_LIG_AMOUNT", i + 1);
-  char uniform[255];
-  sprintf(uniform, "PNT_LIGS[%i].COL", i);
-  canvas_uni3f(shader, uniform, pnt_lig.col[0], pnt_lig.col[1], pnt_lig.col[2]);
-  sprintf(uniform, "PNT_LIGS[%i].POS", i);
-  canvas_uni3f(shader, uniform, pnt_lig.pos[0], pnt_lig.pos[1], pnt_lig.pos[2]);
-  sprintf(uniform, "PNT_LIGS[%i].CON", i);
-  canvas_uni1f(shader, uniform, pnt_lig.con);
-  sprintf(uniform, "PNT_LIGS[%i].LIN", i);
-  canvas_uni1f(shader, uniform, pnt_lig.lin);
-  sprintf(uniform, "PNT_LIGS[%i].QUA", i);
-  canvas_uni1f(shader, uniform, pnt_lig.qua);
-}
-
-void canvas_set_spt_lig(u32 shader, SptLig spt_lig, u32 i) {
-  canvas_uni1i(shader, "SPT_LIG_AMOUNT", i + 1);
-  char uniform[255];
-  sprintf(uniform, "SPT_LIGS[%i].COL", i);
-  canvas_uni3f(shader, uniform, spt_lig.col[0], spt_lig.col[1], spt_lig.col[2]);
-  sprintf(uniform, "SPT_LIGS[%i].POS", i);
-  canvas_uni3f(shader, uniform, spt_lig.pos[0], spt_lig.pos[1], spt_lig.pos[2]);
-  sprintf(uniform, "SPT_LIGS[%i].DIR", i);
-  canvas_uni3f(shader, uniform, spt_lig.dir[0], spt_lig.dir[1], spt_lig.dir[2]);
-  sprintf(uniform, "SPT_LIGS[%i].CON", i);
-  canvas_uni1f(shader, uniform, spt_lig.con);
-  sprintf(uniform, "SPT_LIGS[%i].LIN", i);
-  canvas_uni1f(shader, uniform, spt_lig.lin);
-  sprintf(uniform, "SPT_LIGS[%i].QUA", i);
-  canvas_uni1f(shader, uniform, spt_lig.qua);
-  sprintf(uniform, "SPT_LIGS[%i].INN", i);
-  canvas_uni1f(shader, uniform, spt_lig.inn);
-  sprintf(uniform, "SPT_LIGS[%i].OUT", i);
-  canvas_uni1f(shader, uniform, spt_lig.out);
+// Lights only take effect once flushed, which drawing does
+void canvas_set_dir_lig(DirLig dir_lig, u32 i) {
+  _DirLigStd140* lig = &light_block.dir[i];
+  glm_vec3_copy(dir_lig.col, lig->col);
+  glm_vec3_copy(dir_lig.dir, lig->dir);
+  light_block.dir_amount = i + 1;
+  light_block_dirty = 1;
+}
+
+void canvas_set_pnt_lig(PntLig pnt_lig, u32 i) {
+  _PntLigStd140* lig = &light_block.pnt[i];
+  glm_vec3_copy(pnt_lig.col, lig->col);
+  glm_vec3_copy(pnt_lig.pos, lig->pos);
+  lig->con = pnt_lig.con;
+  lig->lin = pnt_lig.lin;
+  lig->qua = pnt_lig.qua;
+  light_block.pnt_amount = i + 1;
+  light_block_dirty = 1;
+}
+
+void canvas_set_spt_lig(SptLig spt_lig, u32 i) {
+  _SptLigStd140* lig = &light_block.spt[i];
+  glm_vec3_copy(spt_lig.col, lig->col);
+  glm_vec3_copy(spt_lig.pos, lig->pos);
+  glm_vec3_copy(spt_lig.dir, lig->dir);
+  lig->con = spt_lig.con;
+  lig->lin = spt_lig.lin;
+  lig->qua = spt_lig.qua;
+  lig->inn = spt_lig.inn;
+  lig->out = spt_lig.out;
+  light_block.spt_amount = i + 1;
+  light_block_dirty = 1;
+}
+
+void _model_draw_light(Model* model, vec3 col, u32 shader) {
+  Material mat = bound_material;
+  glm_vec3_copy(col, mat.col);
+  mat.lig = 1;
+  canvas_set_material(shader, mat);
+  model_draw(model, shader);
 }
 
 void model_draw_dir_light(Model* model, DirLig lig, u32 shader) {
-  canvas_uni3f(shader, "MAT.COL", lig.col[0], lig.col[1], lig.col[2]);
-  canvas_uni1i(shader, "MAT.LIG", 1);
-  glBindBuffer(GL_ARRAY_BUFFER, model->VBO);
-  glBindVertexArray(model->VAO);
-  canvas_unim4(shader, "MODEL", model->model[0]);
-  glDrawArrays(GL_TRIANGLES, 0, model->size);
+  _model_draw_light(model, lig.col, shader);
 }
 
 void model_draw_pnt_light(Model* model, PntLig lig, u32 shader) {
   glm_translate(model->model, lig.pos);
-  canvas_uni3f(shader, "MAT.COL", lig.col[0], lig.col[1], lig.col[2]);
-  canvas_uni1i(shader, "MAT.LIG", 1);
-  glBindBuffer(GL_ARRAY_BUFFER, model->VBO);
-  glBindVertexArray(model->VAO);
-  canvas_unim4(shader, "MODEL", model->model[0]);
-  glDrawArrays(GL_TRIANGLES, 0, model->size);
+  _model_draw_light(model, lig.col, shader);
 }
 
 void model_draw_spt_light(Model* model, SptLig lig, u32 shader) {
   glm_translate(model->model, lig.pos);
-  canvas_uni3f(shader, "MAT.COL", lig.col[0], lig.col[1], lig.col[2]);
-  canvas_uni1i(shader, "MAT.LIG", 1);
-  glBindBuffer(GL_ARRAY_BUFFER, model->VBO);
-  glBindVertexArray(model->VAO);
-  canvas_unim4(shader, "MODEL", model->model[0]);
-  glDrawArrays(GL_TRIANGLES, 0, model->size);
+  _model_draw_light(model, lig.col, shader);
 }
 
 // HUD
@@ -538,8 +1583,7 @@ void hud_draw_rec(u32 shader, GLenum texture, vec3 color, i32 x, i32 y, i32 widt
   canvas_uni1i(shader, "S_TEX", texture ? (texture - GL_TEXTURE0) : 29);
   canvas_uni3f(shader, "COL",   color[0], color[1], color[2]);
 
-  glBindBuffer(GL_ARRAY_BUFFER, PLANE_VBO);
-  glBindVertexArray(PLANE_VAO);
+  canvas_bind_VAO(PLANE_VAO);
   glDrawArrays(GL_TRIANGLES, 0, 6);
 }
 
@@ -551,16 +1595,49 @@ typedef struct {
   f32 ratio;
 } Font;
 
-void hud_draw_text(u32 shader, char* text, i32 x, i32 y, Font font, vec3 color) {
-  canvas_uni1i(shader, "TILE_AMOUNT", 95);
+#define FONT_TILES 95
+
+u32 TEXT_VAO;
+
+// Glyph quads are built on the CPU into the stream so a string is a single draw, returns its first vertex
+u32 _text_quads(char* text, f32 x, f32 y, f32 width, f32 height, f32 advance) {
+  u32 length = strlen(text), offset;
+  f32 (*vertexes)[5] = canvas_stream_map(&STREAM, length * sizeof(PLANE_VERTEXES), sizeof(PLANE_VERTEXES[0]), &offset);
+
+  for (u32 i = 0; i < length; i++)
+    for (u8 j = 0; j < 6; j++) {
+      const f32* plane = PLANE_VERTEXES[j];
+      f32* vertex = vertexes[i * 6 + j];
+      vertex[0] = x + advance * i + plane[0] * width;
+      vertex[1] = y + plane[1] * height;
+      vertex[2] = 0;
+      vertex[3] = (plane[3] + text[i] - 32) / FONT_TILES;
+      vertex[4] = plane[4];
+    }
 
-  for (u8 i = 0; text[i]; i++) {
-    canvas_uni1i(shader, "TILE", text[i] - 32);
-    hud_draw_rec(shader, font.texture, color, x + (font.size + font.spacing) * i, y, font.size, font.size * font.ratio);
+  canvas_stream_unmap(&STREAM);
+
+  if (!TEXT_VAO) {
+    TEXT_VAO = canvas_create_VAO();
+    glBindBuffer(GL_ARRAY_BUFFER, STREAM.VBO);
+    canvas_vertex_attrib_pointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(f32), (void*) 0);
+    canvas_vertex_attrib_pointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(f32), (void*) (3 * sizeof(f32)));
   }
 
-  canvas_uni1i(shader, "TILE_AMOUNT", 0);
-  canvas_uni1i(shader, "TILE", 0);
+  canvas_bind_VAO(TEXT_VAO);
+  return offset / sizeof(PLANE_VERTEXES[0]);
+}
+
+void hud_draw_text(u32 shader, char* text, i32 x, i32 y, Font font, vec3 color) {
+  if (!text[0]) return;
+  u32 first = _text_quads(text, x, y, font.size, font.size * font.ratio, font.size + font.spacing);
+
+  mat4 model;
+  glm_mat4_identity(model);
+  canvas_unim4(shader, "MODEL", *model);
+  canvas_uni1i(shader, "S_TEX", font.texture ? (font.texture - GL_TEXTURE0) : 29);
+  canvas_uni3f(shader, "COL",   color[0], color[1], color[2]);
+  glDrawArrays(GL_TRIANGLES, first, strlen(text) * 6);
 }
 
 f32 canvas_text_width(char* text, Font font, f32 size) {
@@ -570,10 +1647,13 @@ f32 canvas_text_width(char* text, Font font, f32 size) {
 }
 
 void canvas_draw_text(u32 shader, char* text, f32 x, f32 y, f32 z, f32 size, Font font, Material material, vec3 rotation) {
+  if (!text[0]) return;
+  u32 first = _text_quads(text, 0, 0, 1, 1, 1 + (f32) font.spacing / font.size);
+
   glDisable(GL_CULL_FACE);
   canvas_set_material(shader, material);
-  canvas_uni1i(shader, "MAT.S_DIF", font.texture ? (font.texture - GL_TEXTURE0) : 29);
-  canvas_uni1i(shader, "TILE_AMOUNT", 95);
+  canvas_uni1i(shader, "S_DIF", font.texture ? (font.texture - GL_TEXTURE0) : 29);
+  canvas_forget_material();
 
   mat4 model;
   glm_mat4_identity(model);
@@ -583,20 +1663,8 @@ void canvas_draw_text(u32 shader, char* text, f32 x, f32 y, f32 z, f32 size, Fon
   glm_rotate(model, rotation[2], VEC3(0, 0, 1));
   glm_scale(model,     VEC3(font.size * size, font.size * font.ratio * size, 1));
 
-  for (u8 i = 0; text[i]; i++) {
-    canvas_uni1i(shader, "TILE", text[i] - 32);
-
-
-    glBindBuffer(GL_ARRAY_BUFFER, PLANE_VBO);
-    glBindVertexArray(PLANE_VAO);
-    canvas_unim4(shader, "MODEL", *model);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-
-    glm_translate(model, VEC3(1 + (font.spacing * size) / (font.size * size), 0, 0));
-  }
-
-  canvas_uni1i(shader, "TILE_AMOUNT", 0);
-  canvas_uni1i(shader, "TILE", 0);
+  canvas_unim4(shader, "MODEL", *model);
+  glDrawArrays(GL_TRIANGLES, first, strlen(text) * 6);
   glEnable(GL_CULL_FACE);
 }
 
@@ -605,62 +1673,108 @@ void canvas_draw_text(u32 shader, char* text, f32 x, f32 y, f32 z, f32 size, Fon
 #define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio.h"
 
+// Sounds are looked up by the index they were configured at, effects are decoded up front and
+// get a few voices sharing the same decoded data so they can overlap, long ones stream from disk
+
+#define SOUND_VOICES 4
+
 typedef struct {
-  ma_sound sound;
-  c8 name[32];
+  c8* name;
+  u8 voices;
+  u8 stream;
+  f32 volume;
+} SoundConfig;
+
+typedef struct {
+  ma_sound voices[SOUND_VOICES];
+  u8 count, next;
 } Sound;
 
 ma_engine engine;
 Sound* sounds;
+SoundConfig* sound_configs;
 u8 sound_count;
 
-void init_audio_engine(c8** names, u8 amount) {
-  ASSERT(ma_engine_init(NULL, &engine) == MA_SUCCESS, "Failed to init audio");
-  sound_count = amount;
+void _sound_load(void* data) {
+  TRACE_BEGIN("sound_load");
+  u8 i = (Sound*) data - sounds;
+  SoundConfig* config = &sound_configs[i];
+  c8 buffer[64] = { 0 };
+  sprintf(buffer, "wav/%s.wav", config->name);
 
-  sounds = malloc(amount * sizeof(Sound));
+  // Packed sounds are decoded from the mapping, miniaudio finds them by the path they're registered with
+  const PackEntry* wav = PACK.data ? pack_find(&PACK, buffer) : NULL;
+  if (wav) ma_resource_manager_register_encoded_data(ma_engine_get_resource_manager(&engine), buffer, PACK.data + wav->offset, wav->size);
 
-  for (u8 i = 0; i < amount; i++) {
-    c8 buffer[64] = { 0 };
-    sprintf(buffer, "wav/%s.wav", names[i]);
-    ASSERT(ma_sound_init_from_file(&engine, buffer, 0, NULL, NULL, &sounds[i].sound) == MA_SUCCESS, "Failed to load %s.wav", names[i]);
-    strcpy(sounds[i].name, names[i]);
-  }
+  // Streamed sounds own their decoder, so they can't be copied into more voices
+  Sound* sound = &sounds[i];
+  u32 flags = config->stream ? MA_SOUND_FLAG_STREAM : MA_SOUND_FLAG_DECODE;
+  sound->count = config->stream ? 1 : CLAMP(config->voices, 1, SOUND_VOICES);
+
+  ASSERT(ma_sound_init_from_file(&engine, buffer, flags, NULL, NULL, &sound->voices[0]) == MA_SUCCESS, "Failed to load %s.wav", config->name);
+  for (u8 j = 1; j < sound->count; j++)
+    ASSERT(ma_sound_init_copy(&engine, &sound->voices[0], flags, NULL, &sound->voices[j]) == MA_SUCCESS, "Failed to copy %s.wav", config->name);
+
+  for (u8 j = 0; j < sound->count; j++)
+    ma_sound_set_volume(&sound->voices[j], config->volume ? config->volume : 1);
+  TRACE_END();
 }
 
-void play_audio(c8* name) {
-  for (int i = 0; i < sound_count; i++) {
-    if (strcmp(sounds[i].name, name)) continue;
-    ma_sound_start(&sounds[i].sound);
-    return;
+Jobs* _audio_jobs;
+
+void _audio_engine_init(void* data) {
+  TRACE_BEGIN("init_audio_engine");
+  ASSERT(ma_engine_init(NULL, &engine) == MA_SUCCESS, "Failed to init audio");
+  for (u8 i = 0; i < sound_count; i++) {
+    if (_audio_jobs) jobs_push(_audio_jobs, _sound_load, NULL, &sounds[i]);
+    else _sound_load(&sounds[i]);
   }
+  TRACE_END();
 }
 
-void set_volume(c8* name, f32 volume) {
-  for (int i = 0; i < sound_count; i++) {
-    if (strcmp(sounds[i].name, name)) continue;
-    ma_sound_set_volume(&sounds[i].sound, volume);
-    return;
-  }
+// With jobs, the engine and every sound are loaded on workers and can be played after jobs_finish
+void init_audio_engine(SoundConfig* configs, u8 amount, Jobs* jobs) {
+  sound_count = amount;
+  sounds = calloc(amount, sizeof(Sound));
+  sound_configs = malloc(amount * sizeof(SoundConfig));
+  memcpy(sound_configs, configs, amount * sizeof(SoundConfig));
+
+  _audio_jobs = jobs;
+  if (jobs) jobs_push(jobs, _audio_engine_init, NULL, NULL);
+  else _audio_engine_init(NULL);
 }
 
-void play_audio_loop(c8* name) {
-  for (int i = 0; i < sound_count; i++) {
-    if (strcmp(sounds[i].name, name) == 0) {
-      ma_sound_set_looping(&sounds[i].sound, 1);
-      ma_sound_start(&sounds[i].sound);
-      return;
+// Starts a free voice, or restarts the one that was started the longest ago if all are playing
+void play_audio(u8 id) {
+  TRACE_BEGIN("play_audio");
+  Sound* sound = &sounds[id];
+  ma_sound* voice = &sound->voices[sound->next];
+
+  for (u8 j = 0; j < sound->count; j++)
+    if (!ma_sound_is_playing(&sound->voices[(sound->next + j) % sound->count])) {
+      voice = &sound->voices[(sound->next + j) % sound->count];
+      break;
     }
-  }
+
+  sound->next = (voice - sound->voices + 1) % sound->count;
+  ma_sound_seek_to_pcm_frame(voice, 0);
+  ma_sound_start(voice);
+  TRACE_END();
 }
 
-void stop_audio(c8* name) {
-  for (int i = 0; i < sound_count; i++) {
-    if (strcmp(sounds[i].name, name) == 0) {
-      ma_sound_stop(&sounds[i].sound);
-      return;
-    }
-  }
+void set_volume(u8 id, f32 volume) {
+  for (u8 j = 0; j < sounds[id].count; j++)
+    ma_sound_set_volume(&sounds[id].voices[j], volume);
+}
+
+void play_audio_loop(u8 id) {
+  ma_sound_set_looping(&sounds[id].voices[0], 1);
+  ma_sound_start(&sounds[id].voices[0]);
+}
+
+void stop_audio(u8 id) {
+  for (u8 j = 0; j < sounds[id].count; j++)
+    ma_sound_stop(&sounds[id].voices[j]);
 }
 
 // Camera
@@ -682,7 +1796,7 @@ void camera_compute_movement(Camera* cam, u8 shader) {
     glm_vec3_add(cam->pos, lateral,  cam->pos);
     glm_vec3_add(cam->pos, frontal,  cam->pos);
     glm_vec3_add(cam->pos, vertical, cam->pos);
-    glUseProgram(shader);
+    canvas_use_program(shader);
     generate_view_mat(cam, shader);
   };
 }
@@ -702,7 +1816,7 @@ void camera_compute_direction(Camera* cam, u8 shader) {
   glm_vec3_copy(VEC3(cos(cam->yaw) * cos(cam->pitch), 0, sin(cam->yaw) * cos(cam->pitch)), cam->rig);
   glm_normalize(cam->rig);
 
-  glUseProgram(shader);
+  canvas_use_program(shader);
   generate_view_mat(cam, shader);
   mouse[0] = x;
   mouse[1] = y;
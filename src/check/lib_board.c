@@ -0,0 +1,72 @@
+#include "lib/snakinator.c"
+
+// The board snakinator_step keeps up to date cell by cell must match the one _write_board draws from
+// scratch, on a snake that grows to MAX_SIZE and then runs over its apple: the head crosses it, the
+// body covers it and the tail leaves it to the apple again
+// The snake winds around the largest board on a cycle through every cell of the lower layer, a row
+// to the right then one up, so it never hits itself whatever its length
+// usage: lib_board, exits with 1 on the first step the boards differ
+
+#define CHECK_AHEAD 8 // Cells ahead of the head the apple is put on, once when the snake is one short of MAX_SIZE and once at it
+#define CHECK_STEPS 4000
+
+// The move that leaves cell n of the cycle
+u8 _check_dir(u32 n) {
+  return n % MAX_TILES < MAX_TILES - 1 ? RIGHT : UP;
+}
+
+// Puts the apple CHECK_AHEAD cells along the cycle from the head at cell n, the cells there are free
+// as the snake is shorter than the cycle, and tells the board since it doesn't follow from a step
+void _check_feed(SnakinatorBatch* batch, u32 n) {
+  Game* game = &batch->games[0];
+  i8* last = game->snake.body[game->snake.size - 1];
+  i32 cell[3] = { last[0], last[1], last[2] };
+  for (u32 k = 0; k < CHECK_AHEAD; k++) game_step_head(cell, _check_dir(n + k), MAX_TILES);
+
+  _hash_apple(game);
+  VEC3_COPY(cell, game->apple);
+  _hash_apple(game);
+  _write_board(batch, 0);
+}
+
+i32 main() {
+  static u8 board[SNAKINATOR_CELLS], expected[SNAKINATOR_CELLS];
+  i8 head[3];
+  u8 apple[3], direction, tiles, done;
+  u16 size;
+  u64 hash;
+  f32 reward;
+  SnakinatorBuffers buffers = { board, head, apple, &direction, &tiles, &size, &hash, &reward, &done };
+  SnakinatorBatch* batch = snakinator_create(1, 1, &buffers);
+
+  Game* game = &batch->games[0];
+  Snake* snake = &game->snake;
+  game->tiles = MAX_TILES;
+  snake->size = MAX_SIZE - 1;
+  i32 cell[3] = { 0, 0, 0 };
+  for (u32 n = 0; n < snake->size; n++) {
+    VEC3_COPY(cell, snake->body[n]);
+    if (n + 1 < snake->size) game_step_head(cell, _check_dir(n), MAX_TILES);
+  }
+  snake->dir = snake->last_dir = snake->last_plane_dir = _check_dir(snake->size - 2);
+  game->hash = game_hash(game);
+  _check_feed(batch, snake->size - 1);
+
+  u32 full = 0;
+  for (u32 step = 0, n = snake->size - 1; step < CHECK_STEPS; step++, n++) {
+    u8 action = _check_dir(n) == UP ? INPUT_UP : INPUT_RIGHT;
+    snakinator_step(batch, &action);
+    ASSERT(!done, "lib_board: the snake died at step %u", step);
+    if (snake->size == MAX_SIZE && !full++) _check_feed(batch, n + 1);
+
+    memcpy(expected, board, SNAKINATOR_CELLS);
+    _write_board(batch, 0);
+    for (u32 c = 0; c < SNAKINATOR_CELLS; c++)
+      ASSERT(expected[c] == board[c], "lib_board: cell %u is %u after step %u at size %u, %u from scratch", c, expected[c], step, snake->size, board[c]);
+  }
+
+  ASSERT(full, "lib_board: the snake never reached MAX_SIZE");
+  PRINT("lib board: %u steps, %u at MAX_SIZE", CHECK_STEPS, full);
+  snakinator_close(batch);
+  return 0;
+}
@@ -0,0 +1,166 @@
+#include "trajectory.h"
+
+// Round trip of the shard format: games played with random inputs are recorded the way the game and
+// libsnakinator record them, then every shard is mapped back and each state rebuilt by the cursor
+// must match the one that was recorded, and seeking into the middle of a shard must land on it too
+// No transition may leave from a game that already ended, those ticks take no action
+// Half the games restart in place when they die like the library, the other half play the death out
+// like the game, shrinking and respawning, and a few start long on the largest board and are fed
+// so the board growth and its cap are in the moves
+// usage: shard_roundtrip [prefix], shards are written to prefix-<stream>-<shard>.shard and removed
+// once checked, exits with 1 on the first state that doesn't match
+
+#define CHECK_STREAMS 8
+#define CHECK_STEPS   200000
+#define CHECK_PREFIX  "roundtrip"
+
+// What a rebuilt state must have of the recorded one
+typedef struct {
+  u64 hash;
+  u8 size, apple[3], tiles, dir;
+  i8 head[3];
+} CheckState;
+
+CheckState* states[CHECK_STREAMS];
+
+void _check_record(CheckState* state, Game* game) {
+  Snake* snake = &game->snake;
+  *state = (CheckState) { .hash = game->hash, .size = snake->size, .apple = { game->apple[0], game->apple[1], game->apple[2] }, .tiles = game->tiles, .dir = snake->dir };
+  if (snake->size) VEC3_COPY(snake->body[snake->size - 1], state->head);
+}
+
+u8 _check_compare(CheckState* state, Game* game) {
+  Snake* snake = &game->snake;
+  return snake->size == state->size && (!snake->size || VEC3_COMPARE(snake->body[snake->size - 1], state->head))
+      && VEC3_COMPARE(game->apple, state->apple) && game->tiles == state->tiles && snake->dir == state->dir
+      && game->hash == state->hash && game_hash(game) == state->hash;
+}
+
+u32 _check_rand(u32* rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 17;
+  *rng ^= *rng << 5;
+  return *rng;
+}
+
+// A new game out of the menu, the long ones wind row by row over most of the largest board
+void _check_start(Game* game, u32 seed, u8 long_start) {
+  game_init(game, seed);
+  game->menu = 0;
+  if (!long_start) return;
+
+  Snake* snake = &game->snake;
+  game->tiles = MAX_TILES;
+  snake->size = MAX_TILES * MAX_TILES / 3;
+  for (u32 i = 0; i < snake->size; i++) {
+    u32 row = i / MAX_TILES, x = i % MAX_TILES;
+    snake->body[i][0] = row % 2 ? MAX_TILES - 1 - x : x;
+    snake->body[i][1] = 0;
+    snake->body[i][2] = row;
+  }
+  snake->dir = snake->last_dir = snake->last_plane_dir = UP;
+  game_randomize_apple(game);
+  game->hash = game_hash(game);
+}
+
+// The apple goes where the head lands on the next tick, unless the body is in the way, returns
+// whether it moved, which the stream is told with a jump as it doesn't follow from a step
+u8 _check_feed(Game* game) {
+  if (game->game_end) return 0;
+  Snake* snake = &game->snake;
+  Game next = *game;
+  game_step(&next);
+  i8* head = next.snake.body[next.snake.size - 1];
+  for (u32 i = 0; i < snake->size; i++)
+    if (VEC3_COMPARE(snake->body[i], head)) return 0;
+
+  _hash_apple(game);
+  VEC3_COPY(head, game->apple);
+  _hash_apple(game);
+  return 1;
+}
+
+i32 main(i32 argc, c8** argv) {
+  const c8* prefix = argc > 1 ? argv[1] : CHECK_PREFIX;
+  static Game games[CHECK_STREAMS];
+  ShardWriter writer;
+  ShardStream streams[CHECK_STREAMS];
+  u32 rng = 9, deaths = 0;
+
+  shard_writer_start(&writer, prefix, CHECK_STREAMS);
+  for (u32 i = 0; i < CHECK_STREAMS; i++) {
+    _check_start(&games[i], i + 1, i % 4 >= 2);
+    states[i] = malloc((CHECK_STEPS + 1) * sizeof(CheckState));
+    shard_stream_open(&streams[i], &writer, i, &games[i]);
+    _check_record(&states[i][0], &games[i]);
+  }
+
+  // The state at every step of a stream, a jump replaces the last one
+  for (u32 step = 0; step < CHECK_STEPS; step++)
+    for (u32 i = 0; i < CHECK_STREAMS; i++) {
+      Game* game = &games[i];
+      u32 r = _check_rand(&rng);
+      u8 action = r % 3 ? INPUT_OTHER : r / 3 % INPUT_MENU;
+      if (i % 4 >= 2 && r / 16 % 4 == 0 && _check_feed(game)) {
+        shard_stream_jump(&streams[i], game);
+        _check_record(&states[i][streams[i].steps], game);
+      }
+      if (action != INPUT_OTHER) game_input(game, action);
+
+      u32 apples = game->events[EVENT_APPLE], dead = game->events[EVENT_DEATH];
+      u8 ending = game->game_end != 0;
+      game_step(game);
+      u8 done = game->events[EVENT_DEATH] != dead;
+      deaths += done;
+
+      if (done && i % 2) {
+        _check_start(game, r, i % 4 >= 2);
+        shard_stream_push(&streams[i], action, -1, 1, game);
+      }
+      else shard_stream_step(&streams[i], action, done ? -1 : game->events[EVENT_APPLE] != apples, done, ending, game);
+      _check_record(&states[i][streams[i].steps], game);
+    }
+
+  u64 steps = 0;
+  for (u32 i = 0; i < CHECK_STREAMS; i++) {
+    steps += streams[i].steps;
+    shard_stream_close(&streams[i]);
+  }
+  shard_writer_stop(&writer);
+
+  u32 shards = 0;
+  u64 checked = 0, bytes = 0, keys = 0;
+  for (u32 i = 0; i < CHECK_STREAMS; i++)
+    for (u32 sequence = 0;; sequence++) {
+      c8 path[512];
+      snprintf(path, sizeof(path), "%s-%03u-%05u.shard", prefix, i, sequence);
+      Shard shard;
+      if (!shard_map(&shard, path)) break;
+
+      ShardCursor cursor;
+      u64 first = shard.header->first;
+      shard_seek(&cursor, &shard, 0);
+      do {
+        ASSERT(_check_compare(&states[i][first + cursor.step], &cursor.game), "%s: step %u doesn't match what was recorded", path, cursor.step);
+        ASSERT(!cursor.game.game_end, "%s: step %u leaves from a game that already ended", path, cursor.step);
+        checked++;
+      } while (shard_next(&cursor));
+
+      u32 middle = shard.header->steps * 3 / 7;
+      shard_seek(&cursor, &shard, middle);
+      ASSERT(_check_compare(&states[i][first + middle], &cursor.game), "%s: seeking to step %u doesn't match what was recorded", path, middle);
+
+      bytes += shard.size;
+      keys += shard.header->keys;
+      shards++;
+      shard_unmap(&shard);
+      remove(path);
+    }
+
+  ASSERT(shards == writer.shards, "%u of the %u shards written were read back", shards, writer.shards);
+  ASSERT(checked == steps, "%llu of the %llu transitions recorded were read back", (unsigned long long) checked, (unsigned long long) steps);
+  // The size is mostly keyframes, the deaths and feeds here take one far more often than playing does
+  PRINT("shard round trip: %llu transitions, %u deaths, %u shards, a keyframe every %.1f transitions, %.2f bytes per transition",
+        (unsigned long long) checked, deaths, shards, (f64) checked / keys, (f64) bytes / checked);
+  return 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// Colors, shared by the GL renderer and the software one
+
+#define WHITE         { 1.00, 1.00, 1.00 }
+#define GRAY          { 0.50, 0.50, 0.50 }
+#define BLACK         { 0.00, 0.00, 0.00 }
+#define PURPLE        { 0.55, 0.41, 0.62 }
+#define PASTEL_BLUE   { 0.69, 0.87, 1.00 }
+#define PASTEL_PINK   { 1.00, 0.75, 0.79 }
+#define PASTEL_GREEN  { 0.60, 0.98, 0.60 }
+#define PASTEL_YELLOW { 1.00, 1.00, 0.60 }
+#define YELLOW        { 0.80, 0.80, 0.30 }
+#define PASTEL_PURPLE { 0.80, 0.70, 1.00 }
+#define DEEP_RED      { 0.60, 0.00, 0.00 }
+#define DEEP_BLUE     { 0.00, 0.00, 0.50 }
+#define DEEP_GREEN    { 0.00, 0.50, 0.00 }
+#define DEEP_PURPLE   { 0.40, 0.00, 0.60 }
+#define DEEP_ORANGE   { 1.00, 0.27, 0.00 }
+#define SHADOW_YELLOW { 0.70, 0.70, 0.20 }
@@ -0,0 +1,78 @@
+#include "pack.h"
+#include <signal.h>
+#include <time.h>
+
+// Runs a fuzz target without libFuzzer: replays the inputs given, or throws random ones at it
+// until -runs is reached, an input that aborts is saved to DRIVER_CRASH to be replayed
+// usage: fuzz_step [-runs N] [-seed S] [inputs...]
+
+#define DRIVER_RUNS  100000
+#define DRIVER_MAX   4096
+#define DRIVER_CRASH "fuzz-crash.bin"
+
+i32 LLVMFuzzerTestOneInput(const u8* data, size_t size);
+extern u64 fuzz_ticks;
+
+u8 input[DRIVER_MAX];
+u32 input_size;
+
+void _driver_abort(i32 signal) {
+  (void) signal;
+  FILE* file = fopen(DRIVER_CRASH, "wb");
+  if (file) {
+    fwrite(input, 1, input_size, file);
+    fclose(file);
+    PRINT("fuzz: input saved to %s", DRIVER_CRASH);
+    fflush(stdout);
+  }
+}
+
+u32 _driver_rand(u32* rng) {
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 17;
+  *rng ^= *rng << 5;
+  return *rng;
+}
+
+f64 _driver_seconds() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+i32 main(i32 argc, c8** argv) {
+  u32 runs = DRIVER_RUNS, rng = time(0), replayed = 0;
+
+  for (i32 i = 1; i < argc; i++) {
+    if      (!strcmp(argv[i], "-runs") && i + 1 < argc) runs = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-seed") && i + 1 < argc) rng = atoi(argv[++i]);
+    else {
+      u32 size;
+      const u8* data = file_map(argv[i], &size);
+      ASSERT(data, "fuzz: can't read %s", argv[i]);
+      LLVMFuzzerTestOneInput(data, size);
+      file_unmap(data, size);
+      replayed++;
+    }
+  }
+
+  if (replayed) {
+    PRINT("fuzz: %u inputs replayed, %llu ticks", replayed, (unsigned long long) fuzz_ticks);
+    return 0;
+  }
+
+  signal(SIGABRT, _driver_abort);
+  rng = rng ? rng : 1;
+  PRINT("fuzz: %u runs from seed %u", runs, rng);
+
+  f64 start = _driver_seconds();
+  for (u32 run = 0; run < runs; run++) {
+    input_size = _driver_rand(&rng) % DRIVER_MAX + 1;
+    for (u32 i = 0; i < input_size; i++) input[i] = _driver_rand(&rng) >> 24;
+    LLVMFuzzerTestOneInput(input, input_size);
+  }
+
+  f64 elapsed = _driver_seconds() - start;
+  PRINT("fuzz: %u runs, %llu ticks, %.2fM ticks/s", runs, (unsigned long long) fuzz_ticks, fuzz_ticks / elapsed / 1e6);
+  return 0;
+}
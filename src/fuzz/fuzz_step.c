@@ -0,0 +1,108 @@
+#include "snake.h"
+
+// Differential fuzzing of game_step_fast against game_step, the reference every faster path must match
+// An input is a seed, a byte for the board size and one for the snake's length to start with, then a
+// byte per command: the low 3 bits are an input for game_input or FUZZ_FEED, the rest how many ticks
+// to step both games after it
+// Starting long and feeding, which puts the apple where the head lands next, get the snake to the
+// board growth quickly, up to the MAX_TILES and MAX_SIZE caps, the FRONT/BACK bounce and the shrink and
+// respawn at the end of a game come anyway
+// Every tick both games must match field for field and the incremental hash the one from scratch,
+// and the board and every cell of the body stay within MAX_TILES, what the library's buffers hold
+// Built with -fsanitize=fuzzer it's a libFuzzer target, linked with driver.c it runs standalone
+
+#define FUZZ_HEADER 6
+#define FUZZ_FEED   7
+
+u64 fuzz_ticks;
+
+#define FUZZ_CHECK(ok, what) if (!(ok)) { PRINT("fuzz: %s at tick %llu", what, (unsigned long long) tick); fflush(stdout); abort(); }
+
+// The body is compared as far as it's ever read, the respawn takes the cells before where the game ended
+void _fuzz_compare(Game* reference, Game* fast, u64 tick) {
+  Snake* a = &reference->snake;
+  Snake* b = &fast->snake;
+  u32 cells = MAX(a->size, reference->game_end) + 1;
+  FUZZ_CHECK(a->size == b->size && a->dir == b->dir && a->last_dir == b->last_dir && a->last_plane_dir == b->last_plane_dir, "snake differs");
+  FUZZ_CHECK(!memcmp(a->body, b->body, cells * sizeof(a->body[0])), "body differs");
+  FUZZ_CHECK(VEC3_COMPARE(reference->apple, fast->apple), "apple differs");
+  FUZZ_CHECK(reference->tiles == fast->tiles, "tiles differs");
+  FUZZ_CHECK(reference->menu == fast->menu, "menu differs");
+  FUZZ_CHECK(reference->game_end == fast->game_end, "game_end differs");
+  FUZZ_CHECK(reference->tick_wait == fast->tick_wait, "tick_wait differs");
+  FUZZ_CHECK(reference->target_fov == fast->target_fov && VEC3_COMPARE(reference->target_pos, fast->target_pos), "camera target differs");
+  FUZZ_CHECK(reference->rng == fast->rng, "rng differs");
+  FUZZ_CHECK(!memcmp(reference->events, fast->events, sizeof(reference->events)), "events differs");
+  FUZZ_CHECK(reference->hash == fast->hash, "hash differs");
+  FUZZ_CHECK(reference->hash == game_hash(reference), "hash from scratch differs");
+
+  FUZZ_CHECK(reference->tiles <= MAX_TILES, "tiles past MAX_TILES");
+  for (u32 i = 0; i < a->size; i++)
+    FUZZ_CHECK(a->body[i][0] >= 0 && a->body[i][0] < reference->tiles && a->body[i][2] >= 0 && a->body[i][2] < reference->tiles, "body off the board");
+}
+
+// The apple goes where the head lands on the next tick, unless the body is in the way
+void _fuzz_feed(Game* game) {
+  Snake* snake = &game->snake;
+  if (game->menu || game->game_end) return;
+
+  Game next = *game;
+  game_step(&next);
+  i8* head = next.snake.body[next.snake.size - 1];
+  for (u32 i = 0; i < snake->size; i++)
+    if (VEC3_COMPARE(snake->body[i], head)) return;
+
+  _hash_apple(game);
+  VEC3_COPY(head, game->apple);
+  _hash_apple(game);
+}
+
+// The snake winds row by row from the corner, heading along its last row
+void _fuzz_lay(Game* game, u32 length) {
+  Snake* snake = &game->snake;
+  for (u32 i = 0; i < length; i++) {
+    u32 row = i / game->tiles, x = i % game->tiles;
+    snake->body[i][0] = row % 2 ? game->tiles - 1 - x : x;
+    snake->body[i][1] = 0;
+    snake->body[i][2] = row;
+  }
+
+  snake->size = length;
+  snake->dir = snake->last_dir = snake->last_plane_dir = (length - 1) / game->tiles % 2 ? LEFT : RIGHT;
+}
+
+i32 LLVMFuzzerTestOneInput(const u8* data, size_t size) {
+  if (size < FUZZ_HEADER) return 0;
+
+  u32 seed;
+  memcpy(&seed, data, sizeof(seed));
+  Game reference, fast;
+  game_init(&reference, seed);
+  reference.tiles = TILES + data[4] % (MAX_TILES - TILES + 1);
+  // The board would have grown past a third full, unless it's at MAX_TILES already
+  u32 longest = reference.tiles == MAX_TILES ? MAX_SIZE : reference.tiles * reference.tiles / 3;
+  _fuzz_lay(&reference, START_SIZE + data[5] % (longest - START_SIZE + 1));
+  game_randomize_apple(&reference);
+  reference.hash = game_hash(&reference);
+  fast = reference;
+
+  u64 tick = 0;
+  for (size_t i = FUZZ_HEADER; i < size; i++) {
+    u8 command = data[i] & 7, ticks = data[i] >> 3;
+    if (command == FUZZ_FEED) {
+      _fuzz_feed(&reference);
+      _fuzz_feed(&fast);
+    }
+    else FUZZ_CHECK(game_input(&reference, command) == game_input(&fast, command), "game_input differs");
+    _fuzz_compare(&reference, &fast, tick);
+
+    for (u8 t = 0; t < ticks; t++, tick++) {
+      game_step(&reference);
+      game_step_fast(&fast);
+      _fuzz_compare(&reference, &fast, tick);
+    }
+  }
+
+  fuzz_ticks += tick;
+  return 0;
+}
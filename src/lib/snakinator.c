@@ -0,0 +1,157 @@
+#include "snakinator.h"
+#include "snake.h"
+#include "raster.h"
+#include "trajectory.h"
+
+_Static_assert(SNAKINATOR_SIZE == MAX_TILES, "SNAKINATOR_SIZE must match MAX_TILES");
+_Static_assert(SNAKINATOR_UP == (i32) INPUT_UP && SNAKINATOR_LEFT == (i32) INPUT_LEFT && SNAKINATOR_LAYER == (i32) INPUT_LAYER, "Actions must match Input");
+_Static_assert(SNAKINATOR_OBLIQUE == (i32) RASTER_OBLIQUE, "Views must match RasterView");
+
+struct SnakinatorBatch {
+  u32 count, seed, episodes;
+  SnakinatorBuffers out;
+  Raster* raster;
+  c8* prefix;
+  ShardWriter* writer;
+  ShardStream* streams;
+  Game games[];
+};
+
+u32 _cell(i32 x, i32 y, i32 z) {
+  return (y * SNAKINATOR_SIZE + z) * SNAKINATOR_SIZE + x;
+}
+
+void _write_scalars(SnakinatorBatch* batch, u32 i) {
+  Game* game = &batch->games[i];
+  i8* head = batch->out.head + i * 3;
+  u8* apple = batch->out.apple + i * 3;
+  VEC3_COPY(game->snake.body[game->snake.size - 1], head);
+  VEC3_COPY(game->apple, apple);
+  batch->out.direction[i] = game->snake.dir;
+  batch->out.tiles[i] = game->tiles;
+  batch->out.size[i] = game->snake.size;
+  batch->out.hash[i] = game->hash;
+}
+
+void _write_board(SnakinatorBatch* batch, u32 i) {
+  Game* game = &batch->games[i];
+  u8* board = &batch->out.board[i * SNAKINATOR_CELLS];
+  memset(board, SNAKINATOR_EMPTY, SNAKINATOR_CELLS);
+
+  // A snake of MAX_SIZE runs over apples, the body is drawn over them
+  board[_cell(game->apple[0], game->apple[1], game->apple[2])] = SNAKINATOR_APPLE;
+  for (u32 j = 0; j < game->snake.size; j++) {
+    i8* cell = game->snake.body[j];
+    board[_cell(cell[0], cell[1], cell[2])] = j == game->snake.size - 1 ? SNAKINATOR_HEAD : SNAKINATOR_BODY;
+  }
+}
+
+void _restart(SnakinatorBatch* batch, u32 i) {
+  game_init(&batch->games[i], batch->seed + batch->episodes++ * 0x9e3779b9);
+  batch->games[i].menu = 0;
+  _write_board(batch, i);
+  _write_scalars(batch, i);
+}
+
+SNAKINATOR_API uint32_t snakinator_abi(void) {
+  return SNAKINATOR_ABI;
+}
+
+SNAKINATOR_API SnakinatorBatch* snakinator_create(uint32_t count, uint32_t seed, const SnakinatorBuffers* buffers) {
+  const SnakinatorBuffers* b = buffers;
+  if (!count || !b || !b->board || !b->head || !b->apple || !b->direction || !b->tiles || !b->size || !b->hash || !b->reward || !b->done) return NULL;
+
+  SnakinatorBatch* batch = malloc(sizeof(SnakinatorBatch) + count * sizeof(Game));
+  if (!batch) return NULL;
+  batch->count = count;
+  batch->seed = seed;
+  batch->episodes = 0;
+  batch->raster = NULL;
+  batch->prefix = NULL;
+  batch->writer = NULL;
+  batch->streams = NULL;
+  batch->out = *buffers;
+  snakinator_reset(batch);
+  return batch;
+}
+
+SNAKINATOR_API void snakinator_reset(SnakinatorBatch* batch) {
+  for (u32 i = 0; i < batch->count; i++) {
+    _restart(batch, i);
+    if (batch->streams) shard_stream_jump(&batch->streams[i], &batch->games[i]);
+    batch->out.reward[i] = 0;
+    batch->out.done[i] = 0;
+  }
+}
+
+// Only the cells a move touches are rewritten: the tail that left, the old and new head and the apple
+// when it respawned. A snake of MAX_SIZE runs over the apple, the tail leaving it gives it back
+SNAKINATOR_API void snakinator_step(SnakinatorBatch* batch, const uint8_t* actions) {
+  for (u32 i = 0; i < batch->count; i++) {
+    Game* game = &batch->games[i];
+    Snake* snake = &game->snake;
+    u8* board = &batch->out.board[i * SNAKINATOR_CELLS];
+
+    if (actions[i] < SNAKINATOR_NOOP) game_input(game, actions[i]);
+
+    u32 apples = game->events[EVENT_APPLE], deaths = game->events[EVENT_DEATH];
+    u32 tail = _cell(snake->body[0][0], snake->body[0][1], snake->body[0][2]);
+    u32 head = _cell(snake->body[snake->size - 1][0], snake->body[snake->size - 1][1], snake->body[snake->size - 1][2]);
+    game_step_fast(game);
+
+    batch->out.done[i] = game->events[EVENT_DEATH] != deaths;
+    batch->out.reward[i] = batch->out.done[i] ? -1 : game->events[EVENT_APPLE] != apples;
+    if (batch->out.done[i]) {
+      _restart(batch, i);
+      if (batch->streams) shard_stream_push(&batch->streams[i], actions[i], -1, 1, game);
+      continue;
+    }
+    if (batch->streams) shard_stream_push(&batch->streams[i], actions[i], batch->out.reward[i], 0, game);
+
+    i8* cell = snake->body[snake->size - 1];
+    u32 apple = _cell(game->apple[0], game->apple[1], game->apple[2]);
+    if (game->events[EVENT_APPLE] == apples) board[tail] = tail == apple ? SNAKINATOR_APPLE : SNAKINATOR_EMPTY;
+    else board[apple] = SNAKINATOR_APPLE;
+    board[head] = SNAKINATOR_BODY;
+    board[_cell(cell[0], cell[1], cell[2])] = SNAKINATOR_HEAD;
+    _write_scalars(batch, i);
+  }
+}
+
+SNAKINATOR_API uint8_t snakinator_render(SnakinatorBatch* batch, uint16_t width, uint16_t height, uint8_t view, uint8_t channels, uint8_t* pixels) {
+  if (!width || !height || view > SNAKINATOR_OBLIQUE || (channels != 1 && channels != 3) || !pixels) return 0;
+
+  Raster* raster = batch->raster;
+  if (!raster || raster->width != width || raster->height != height || raster->view != view || raster->channels != channels) {
+    if (!raster && !(raster = batch->raster = malloc(sizeof(Raster)))) return 0;
+    raster_init(raster, width, height, view, channels);
+  }
+
+  raster_draw_batch(raster, batch->games, batch->count, pixels);
+  return 1;
+}
+
+// The prefix is copied since the caller's string may not outlive the call
+SNAKINATOR_API uint8_t snakinator_record(SnakinatorBatch* batch, const char* prefix) {
+  if (batch->writer || !prefix) return 0;
+
+  batch->prefix = malloc(strlen(prefix) + 1);
+  batch->writer = malloc(sizeof(ShardWriter));
+  batch->streams = malloc(batch->count * sizeof(ShardStream));
+  strcpy(batch->prefix, prefix);
+  shard_writer_start(batch->writer, batch->prefix, batch->count);
+  for (u32 i = 0; i < batch->count; i++) shard_stream_open(&batch->streams[i], batch->writer, i, &batch->games[i]);
+  return 1;
+}
+
+SNAKINATOR_API void snakinator_close(SnakinatorBatch* batch) {
+  if (batch->writer) {
+    for (u32 i = 0; i < batch->count; i++) shard_stream_close(&batch->streams[i]);
+    shard_writer_stop(batch->writer);
+    free(batch->streams);
+    free(batch->writer);
+    free(batch->prefix);
+  }
+  free(batch->raster);
+  free(batch);
+}
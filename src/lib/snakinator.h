@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+
+// libsnakinator
+
+// A batch of games stepped together for training, loaded through ctypes/cffi
+// The caller owns every array: observations are written straight into the buffers given to
+// snakinator_create, so stepping never allocates or copies more than the cells that changed
+// Only fixed width types cross the boundary, and SNAKINATOR_ABI bumps whenever a layout does
+
+#define SNAKINATOR_ABI 1
+
+// Every game's board is SNAKINATOR_LAYERS x SNAKINATOR_SIZE x SNAKINATOR_SIZE cells indexed [y][z][x],
+// big enough for the largest board since the game stops growing it there, the cells past the current
+// tiles stay empty
+#define SNAKINATOR_SIZE   25
+#define SNAKINATOR_LAYERS 2
+#define SNAKINATOR_CELLS  (SNAKINATOR_LAYERS * SNAKINATOR_SIZE * SNAKINATOR_SIZE)
+
+enum { SNAKINATOR_EMPTY, SNAKINATOR_BODY, SNAKINATOR_HEAD, SNAKINATOR_APPLE };
+
+// Views of snakinator_render, straight from above or from the front and above like the game camera
+enum { SNAKINATOR_TOP, SNAKINATOR_OBLIQUE };
+
+// Actions, any other value leaves the direction alone
+enum { SNAKINATOR_UP, SNAKINATOR_DOWN, SNAKINATOR_RIGHT, SNAKINATOR_LEFT, SNAKINATOR_LAYER, SNAKINATOR_NOOP };
+
+#if defined(_WIN32)
+#define SNAKINATOR_API __declspec(dllexport)
+#else
+#define SNAKINATOR_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One entry per game in each array, board holds SNAKINATOR_CELLS per game, head and apple 3 (x, y, z)
+typedef struct {
+  uint8_t* board;
+  int8_t* head;
+  uint8_t* apple;
+  uint8_t* direction;
+  uint8_t* tiles;
+  uint16_t* size;
+  uint64_t* hash;
+  float* reward;
+  uint8_t* done;
+} SnakinatorBuffers;
+
+typedef struct SnakinatorBatch SnakinatorBatch;
+
+SNAKINATOR_API uint32_t snakinator_abi(void);
+
+// The buffers must stay valid until snakinator_close, returns NULL on a bad count or missing buffer
+SNAKINATOR_API SnakinatorBatch* snakinator_create(uint32_t count, uint32_t seed, const SnakinatorBuffers* buffers);
+
+// Restarts every game and writes the first observations
+SNAKINATOR_API void snakinator_reset(SnakinatorBatch* batch);
+
+// Applies one action per game and advances each by a tick, a game that ends sets done, gets a
+// reward of -1 and is restarted in place, so the observation is already the next episode's first
+SNAKINATOR_API void snakinator_step(SnakinatorBatch* batch, const uint8_t* actions);
+
+// Draws every game into consecutive width x height images of 1 (gray) or 3 (RGB) channels,
+// the tables behind it are rebuilt only when the arguments change, returns 0 on bad arguments
+SNAKINATOR_API uint8_t snakinator_render(SnakinatorBatch* batch, uint16_t width, uint16_t height, uint8_t view, uint8_t channels, uint8_t* pixels);
+
+// Streams every transition from now on to shard files named prefix-<game>-<shard>.shard, one stream
+// per game, written on a background thread, see trajectory.h for the layout, returns 0 if already recording
+SNAKINATOR_API uint8_t snakinator_record(SnakinatorBatch* batch, const char* prefix);
+
+// Also flushes and closes what's being recorded
+SNAKINATOR_API void snakinator_close(SnakinatorBatch* batch);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,155 @@
+#pragma once
+#include "types.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Pack
+
+// Every asset in one file, built by tools/pack.c: a header, a table of contents sorted by the FNV-1a
+// hash of each path, then the files themselves, each starting PACK_ALIGN aligned and followed by a 0
+// so text assets can be used as strings straight from the mapping
+
+#define PACK_MAGIC   0x4b504e53
+#define PACK_VERSION 1
+#define PACK_ALIGN   16
+
+typedef struct {
+  u32 magic, version, count, size;
+} PackHeader;
+
+typedef struct {
+  u64 hash;
+  u32 offset, size;
+} PackEntry;
+
+typedef struct {
+  const u8* data;
+  u32 size, count;
+  const PackEntry* entries;
+} Pack;
+
+Pack PACK;
+
+u64 pack_hash(const c8* path) {
+  u64 hash = 0xcbf29ce484222325;
+  for (; *path; path++) hash = (hash ^ (u8) *path) * 0x100000001b3;
+  return hash;
+}
+
+u8 pack_open(Pack* pack, const u8* data, u32 size) {
+  const PackHeader* header = (const PackHeader*) data;
+  if (size < sizeof(PackHeader) || header->magic != PACK_MAGIC || header->version != PACK_VERSION || header->size != size) return 0;
+
+  *pack = (Pack) { data, size, header->count, (const PackEntry*) (header + 1) };
+  return 1;
+}
+
+// Maps a whole file read-only, or reads it where mmap isn't available, NULL if it can't be opened
+const u8* file_map(const c8* path, u32* size) {
+  #ifdef _WIN32
+  FILE* file = fopen(path, "rb");
+  if (!file) return NULL;
+  fseek(file, 0, SEEK_END);
+  *size = ftell(file);
+  rewind(file);
+
+  u8* data = malloc(*size);
+  u8 read = fread(data, 1, *size, file) == *size;
+  fclose(file);
+  if (read) return data;
+  free(data);
+  return NULL;
+  #else
+  i32 file = open(path, O_RDONLY);
+  if (file < 0) return NULL;
+
+  struct stat st;
+  void* data = fstat(file, &st) ? MAP_FAILED : mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (data == MAP_FAILED) return NULL;
+  *size = st.st_size;
+  return data;
+  #endif
+}
+
+void file_unmap(const u8* data, u32 size) {
+  #ifdef _WIN32
+  free((void*) data);
+  #else
+  munmap((void*) data, size);
+  #endif
+}
+
+// Maps the archive, the data lives until exit
+u8 pack_map(Pack* pack, const c8* path) {
+  u32 size;
+  const u8* data = file_map(path, &size);
+  if (!data) return 0;
+  if (pack_open(pack, data, size)) return 1;
+  file_unmap(data, size);
+  return 0;
+}
+
+const PackEntry* pack_find(Pack* pack, const c8* path) {
+  u64 hash = pack_hash(path);
+  u32 low = 0, high = pack->count;
+
+  while (low < high) {
+    u32 mid = (low + high) / 2;
+    if      (pack->entries[mid].hash < hash) low  = mid + 1;
+    else if (pack->entries[mid].hash > hash) high = mid;
+    else return &pack->entries[mid];
+  }
+  return NULL;
+}
+
+// Asset
+
+// Loaders get their files through asset_load, a slice of PACK when it's open, otherwise the loose
+// file read into memory, both end with a 0 that isn't counted in size
+
+typedef struct {
+  const u8* data;
+  u32 size;
+  u8 owned;
+} Asset;
+
+#ifdef PACK_EMBED
+extern const unsigned char PACK_EMBEDDED[];
+extern const unsigned int  PACK_EMBEDDED_SIZE;
+#endif
+
+// Opens the archive linked into the binary, or the one at path, returns 0 if assets will be loose files
+u8 assets_open(const c8* path) {
+  #ifdef PACK_EMBED
+  if (pack_open(&PACK, PACK_EMBEDDED, PACK_EMBEDDED_SIZE)) return 1;
+  #endif
+  return pack_map(&PACK, path);
+}
+
+Asset asset_load(const c8* path) {
+  const PackEntry* entry = PACK.data ? pack_find(&PACK, path) : NULL;
+  if (entry) return (Asset) { PACK.data + entry->offset, entry->size, 0 };
+
+  FILE* file = fopen(path, "rb");
+  if (!file) return (Asset) { 0 };
+  fseek(file, 0, SEEK_END);
+  u32 size = ftell(file);
+  rewind(file);
+
+  u8* data = malloc(size + 1);
+  size = fread(data, 1, size, file);
+  data[size] = 0;
+  fclose(file);
+  return (Asset) { data, size, 1 };
+}
+
+void asset_free(Asset* asset) {
+  if (asset->owned) free((void*) asset->data);
+  *asset = (Asset) { 0 };
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include "snake.h"
+#include "colors.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RASTER_SSE2
+#endif
+
+// Raster
+
+// Draws the board on the CPU into small images for models that learn from pixels, no GL involved
+// Every cell is a box seen straight from above, or from the front and above like the game camera,
+// so the scene is flat colored rectangles painted back to front: the floor, the shadows of raised
+// cells, then the snake and the apple row by row, the lower layer first
+// Where the edges of every cell land and every color in the output format are worked out once in
+// raster_init, drawing is only lookups and span fills
+
+#define RASTER_LIFT  0.5 // How far up the screen a unit of height goes in the oblique view
+#define RASTER_SHADE 0.6 // Front faces are darkened like the obj shader does
+#define RASTER_GRADIENT 0.003 // Per segment from the head, the same as the game's snake material
+
+enum { RASTER_TOP, RASTER_OBLIQUE } RasterView;
+enum { RASTER_CLEAR, RASTER_FLOOR, RASTER_SHADOW, RASTER_APPLE, RASTER_SNAKE } RasterColor;
+
+// The snake's color darkens with each segment, so each distance from the head has its own
+#define RASTER_COLORS (RASTER_SNAKE + MAX_TILES * MAX_TILES * 2 + 1)
+
+typedef struct {
+  u16 width, height;
+  u8 view, channels;
+  u16 edge_x[MAX_TILES + 1][MAX_TILES + 1];
+  u16 edge_y[MAX_TILES + 1][MAX_TILES + 1][4];
+  u8 palette[RASTER_COLORS][2][3];
+} Raster;
+
+void _raster_color(Raster* raster, u16 index, const f32 color[3]) {
+  for (u8 face = 0; face < 2; face++) {
+    f32 rgb[3];
+    for (u8 c = 0; c < 3; c++) rgb[c] = CLAMP(0, color[c] * (face ? RASTER_SHADE : 1), 1);
+
+    u8* out = raster->palette[index][face];
+    if (raster->channels == 1) out[0] = (0.299 * rgb[0] + 0.587 * rgb[1] + 0.114 * rgb[2]) * 255 + 0.5;
+    else for (u8 c = 0; c < 3; c++) out[c] = rgb[c] * 255 + 0.5;
+  }
+}
+
+// Channels is 1 for grayscale or 3 for RGB, images are rows from the top
+void raster_init(Raster* raster, u16 width, u16 height, u8 view, u8 channels) {
+  *raster = (Raster) { width, height, view, channels };
+  f32 lift = view == RASTER_OBLIQUE ? RASTER_LIFT : 0;
+
+  // The tallest thing is a raised cell, 3 units up from the bottom of the floor
+  for (u8 tiles = 1; tiles <= MAX_TILES; tiles++) {
+    f32 scale = MIN((f32) width / tiles, height / (tiles + 3 * lift));
+    f32 left = (width - tiles * scale) / 2;
+    f32 top = (height - (tiles + 3 * lift) * scale) / 2 + 3 * lift * scale;
+
+    for (u8 i = 0; i <= tiles; i++) {
+      raster->edge_x[tiles][i] = left + i * scale + 0.5;
+      for (u8 h = 0; h < 4; h++) raster->edge_y[tiles][i][h] = top + (i - h * lift) * scale + 0.5;
+    }
+  }
+
+  _raster_color(raster, RASTER_CLEAR,  (f32[3]) PASTEL_PURPLE);
+  _raster_color(raster, RASTER_FLOOR,  (f32[3]) YELLOW);
+  _raster_color(raster, RASTER_SHADOW, (f32[3]) SHADOW_YELLOW);
+  _raster_color(raster, RASTER_APPLE,  (f32[3]) DEEP_RED);
+
+  f32 snake[3] = DEEP_PURPLE;
+  for (u32 i = RASTER_SNAKE; i < RASTER_COLORS; i++) {
+    f32 distance = (i - RASTER_SNAKE) * RASTER_GRADIENT;
+    _raster_color(raster, i, (f32[3]) { snake[0] - distance, snake[1] - distance, snake[2] - distance });
+  }
+}
+
+// Sixteen pixels at a time from a pattern of the color repeated, RGB repeats every 48 bytes
+void _raster_span(u8* row, u16 from, u16 to, const u8* color, u8 channels) {
+  if (from >= to) return;
+  if (channels == 1) {
+    memset(row + from, color[0], to - from);
+    return;
+  }
+
+  u8* at = row + from * 3;
+  u32 left = to - from;
+  #ifdef RASTER_SSE2
+  if (left >= 16) {
+    u8 pattern[48];
+    for (u8 i = 0; i < 48; i++) pattern[i] = color[i % 3];
+    __m128i a = _mm_loadu_si128((__m128i*) pattern), b = _mm_loadu_si128((__m128i*) (pattern + 16)), c = _mm_loadu_si128((__m128i*) (pattern + 32));
+    for (; left >= 16; left -= 16, at += 48) {
+      _mm_storeu_si128((__m128i*) at, a);
+      _mm_storeu_si128((__m128i*) (at + 16), b);
+      _mm_storeu_si128((__m128i*) (at + 32), c);
+    }
+  }
+  #endif
+  for (; left; left--, at += 3) VEC3_COPY(color, at);
+}
+
+void _raster_rect(Raster* raster, u8* pixels, u16 x0, u16 x1, u16 y0, u16 y1, const u8* color) {
+  u32 stride = raster->width * raster->channels;
+  for (u16 y = y0; y < y1; y++) _raster_span(pixels + y * stride, x0, x1, color, raster->channels);
+}
+
+// The top of a box from x0 to x1 and z to z + 1 at height h, and its front face down to h - 1
+void _raster_box(Raster* raster, u8* pixels, u8 tiles, u8 x0, u8 x1, u8 z, u8 h, u16 color) {
+  u16* y = raster->edge_y[tiles][z];
+  u16* y_front = raster->edge_y[tiles][z + 1];
+  u16 left = raster->edge_x[tiles][x0], right = raster->edge_x[tiles][x1];
+
+  _raster_rect(raster, pixels, left, right, y[h], y_front[h], raster->palette[color][0]);
+  if (h) _raster_rect(raster, pixels, left, right, y_front[h], y_front[h - 1], raster->palette[color][1]);
+}
+
+// A shadow is flat on the floor under a raised cell, a top with no front face like the GL one scaled to y = 0
+void _raster_shadow(Raster* raster, u8* pixels, u8 tiles, u8 x, u8 z) {
+  _raster_rect(raster, pixels, raster->edge_x[tiles][x], raster->edge_x[tiles][x + 1], raster->edge_y[tiles][z][1], raster->edge_y[tiles][z + 1][1], raster->palette[RASTER_SHADOW][0]);
+}
+
+void raster_draw(Raster* raster, Game* game, u8* pixels) {
+  Snake* snake = &game->snake;
+  u8 tiles = game->tiles;
+
+  _raster_rect(raster, pixels, 0, raster->width, 0, raster->height, raster->palette[RASTER_CLEAR][0]);
+
+  // The floor is a single box as wide as the board, shadows sit on top of it
+  u16* floor_y = raster->edge_y[tiles][0];
+  _raster_rect(raster, pixels, raster->edge_x[tiles][0], raster->edge_x[tiles][tiles], floor_y[1], raster->edge_y[tiles][tiles][1], raster->palette[RASTER_FLOOR][0]);
+  _raster_rect(raster, pixels, raster->edge_x[tiles][0], raster->edge_x[tiles][tiles], raster->edge_y[tiles][tiles][1], raster->edge_y[tiles][tiles][0], raster->palette[RASTER_FLOOR][1]);
+
+  if (game->apple[1]) _raster_shadow(raster, pixels, tiles, game->apple[0], game->apple[2]);
+  for (u32 i = 0; i < snake->size; i++)
+    if (snake->body[i][1]) _raster_shadow(raster, pixels, tiles, snake->body[i][0], snake->body[i][2]);
+
+  // Counting sort of the cells by row then layer, the apple is index size and goes first in its bucket:
+  // a snake of MAX_SIZE runs over it and the body is drawn on top, like on the library's board
+  u16 start[MAX_TILES * 2 + 1] = { 0 };
+  u16 order[MAX_TILES * MAX_TILES * 2 + 1];
+  for (u32 i = 0; i < snake->size; i++) start[snake->body[i][2] * 2 + snake->body[i][1] + 1]++;
+  start[game->apple[2] * 2 + game->apple[1] + 1]++;
+  for (u8 i = 1; i <= tiles * 2; i++) start[i] += start[i - 1];
+  order[start[game->apple[2] * 2 + game->apple[1]]++] = snake->size;
+  for (u32 i = 0; i < snake->size; i++) order[start[snake->body[i][2] * 2 + snake->body[i][1]]++] = i;
+
+  for (u32 i = 0; i <= snake->size; i++) {
+    u16 j = order[i];
+    u8* cell = j < snake->size ? (u8*) snake->body[j] : game->apple;
+    u16 color = j < snake->size ? RASTER_SNAKE + snake->size - j : RASTER_APPLE;
+    _raster_box(raster, pixels, tiles, cell[0], cell[0] + 1, cell[2], cell[1] + 2, color);
+  }
+}
+
+// Games are drawn one after the other into consecutive images, all sharing the tables
+void raster_draw_batch(Raster* raster, Game* games, u32 count, u8* pixels) {
+  u32 frame = raster->width * raster->height * raster->channels;
+  for (u32 i = 0; i < count; i++) raster_draw(raster, &games[i], pixels + i * frame);
+}
@@ -0,0 +1,195 @@
+#pragma once
+#include "snake.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define REACH_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define REACH_SSE2
+#endif
+
+// Reach
+
+// How much of the board an agent can still get to, for trap avoidance
+// The board is a bitboard per y layer, a u32 row per z with bit x set for free cells, and the
+// reachable set grows by a shift/OR dilation that wraps x and z around the torus and swaps layers
+// reach_bfs is the plain flood over the same board, kept as the baseline and to check the others
+
+#define REACH_ROWS 32
+
+typedef struct {
+  _Alignas(32) u32 rows[2][REACH_ROWS];
+  u8 tiles;
+} Bitboard;
+
+enum { FLOOD_BFS, FLOOD_SCALAR, FLOOD_SSE2, FLOOD_AVX2, FLOOD_AMOUNT } Flood;
+
+const c8* FLOOD_NAMES[FLOOD_AMOUNT] = { "bfs", "scalar", "sse2", "avx2" };
+
+// Every cell is free but the body, the tail counts as free since it moves out of the way on the next step
+void bitboard_free(Game* game, Bitboard* board) {
+  *board = (Bitboard) { .tiles = game->tiles };
+  for (u8 z = 0; z < game->tiles; z++)
+    board->rows[0][z] = board->rows[1][z] = (1u << game->tiles) - 1;
+
+  for (u32 i = 1; i < game->snake.size; i++) {
+    i8* cell = game->snake.body[i];
+    board->rows[cell[1]][cell[2]] &= ~(1u << cell[0]);
+  }
+}
+
+u32 bitboard_count(Bitboard* board) {
+  u32 count = 0;
+  for (u8 y = 0; y < 2; y++)
+    for (u8 z = 0; z < board->tiles; z++)
+      for (u32 row = board->rows[y][z]; row; row &= row - 1) count++;
+  return count;
+}
+
+u32 reach_bfs(Bitboard* free, i32 x, i32 y, i32 z) {
+  u8 tiles = free->tiles;
+  if (!(free->rows[y][z] >> x & 1)) return 0;
+
+  u8 seen[2][MAX_TILES][MAX_TILES] = { 0 };
+  u16 queue[2 * MAX_TILES * MAX_TILES][3];
+  u32 head = 0, tail = 0;
+  seen[y][z][x] = 1;
+  queue[tail][0] = x, queue[tail][1] = y, queue[tail][2] = z, tail++;
+
+  while (head < tail) {
+    u16* cell = queue[head++];
+    i32 next[5][3] = {
+      { (cell[0] + 1) % tiles, cell[1], cell[2] }, { (cell[0] + tiles - 1) % tiles, cell[1], cell[2] },
+      { cell[0], cell[1], (cell[2] + 1) % tiles }, { cell[0], cell[1], (cell[2] + tiles - 1) % tiles },
+      { cell[0], !cell[1], cell[2] }
+    };
+
+    for (u8 i = 0; i < 5; i++) {
+      i32 nx = next[i][0], ny = next[i][1], nz = next[i][2];
+      if (seen[ny][nz][nx] || !(free->rows[ny][nz] >> nx & 1)) continue;
+      seen[ny][nz][nx] = 1;
+      queue[tail][0] = nx, queue[tail][1] = ny, queue[tail][2] = nz, tail++;
+    }
+  }
+
+  return tail;
+}
+
+// One dilation of reach into next, returns whether it grew
+u8 _reach_scalar(Bitboard* reach, Bitboard* next, Bitboard* free) {
+  u8 tiles = free->tiles, grew = 0;
+
+  for (u8 y = 0; y < 2; y++)
+    for (u8 z = 0; z < tiles; z++) {
+      u32 row = reach->rows[y][z];
+      u32 grown = row | row << 1 | row >> (tiles - 1) | row >> 1 | (row & 1) << (tiles - 1)
+                | reach->rows[y][z ? z - 1 : tiles - 1] | reach->rows[y][z + 1 < tiles ? z + 1 : 0] | reach->rows[!y][z];
+      next->rows[y][z] = grown & free->rows[y][z];
+      grew |= next->rows[y][z] != row;
+    }
+
+  return grew;
+}
+
+// The z neighbours are unaligned loads from a copy of the rows padded with the wrapped ones,
+// the rows past tiles stay 0 since they're never free
+void _reach_pad(Bitboard* reach, u32 padded[2][REACH_ROWS + 8]) {
+  u8 tiles = reach->tiles;
+  for (u8 y = 0; y < 2; y++) {
+    padded[y][0] = reach->rows[y][tiles - 1];
+    memcpy(&padded[y][1], reach->rows[y], REACH_ROWS * sizeof(u32));
+    padded[y][tiles + 1] = reach->rows[y][0];
+  }
+}
+
+#ifdef REACH_SSE2
+u8 _reach_sse2(Bitboard* reach, Bitboard* next, Bitboard* free, u32 padded[2][REACH_ROWS + 8]) {
+  __m128i left = _mm_cvtsi32_si128(reach->tiles - 1), one = _mm_set1_epi32(1), grew = _mm_setzero_si128();
+  _reach_pad(reach, padded);
+
+  for (u8 y = 0; y < 2; y++)
+    for (u8 z = 0; z < REACH_ROWS; z += 4) {
+      __m128i row = _mm_load_si128((__m128i*) &reach->rows[y][z]);
+      __m128i x = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(row, 1), _mm_srl_epi32(row, left)),
+                               _mm_or_si128(_mm_srli_epi32(row, 1), _mm_sll_epi32(_mm_and_si128(row, one), left)));
+      __m128i z_y = _mm_or_si128(_mm_or_si128(_mm_loadu_si128((__m128i*) &padded[y][z]), _mm_loadu_si128((__m128i*) &padded[y][z + 2])),
+                                 _mm_load_si128((__m128i*) &reach->rows[!y][z]));
+      __m128i grown = _mm_and_si128(_mm_or_si128(_mm_or_si128(row, x), z_y), _mm_load_si128((__m128i*) &free->rows[y][z]));
+      _mm_store_si128((__m128i*) &next->rows[y][z], grown);
+      grew = _mm_or_si128(grew, _mm_xor_si128(grown, row));
+    }
+
+  return _mm_movemask_epi8(_mm_cmpeq_epi32(grew, _mm_setzero_si128())) != 0xffff;
+}
+#endif
+
+#ifdef REACH_AVX2
+u8 _reach_avx2(Bitboard* reach, Bitboard* next, Bitboard* free, u32 padded[2][REACH_ROWS + 8]) {
+  __m128i left = _mm_cvtsi32_si128(reach->tiles - 1);
+  __m256i one = _mm256_set1_epi32(1), grew = _mm256_setzero_si256();
+  _reach_pad(reach, padded);
+
+  for (u8 y = 0; y < 2; y++)
+    for (u8 z = 0; z < REACH_ROWS; z += 8) {
+      __m256i row = _mm256_load_si256((__m256i*) &reach->rows[y][z]);
+      __m256i x = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(row, 1), _mm256_srl_epi32(row, left)),
+                                  _mm256_or_si256(_mm256_srli_epi32(row, 1), _mm256_sll_epi32(_mm256_and_si256(row, one), left)));
+      __m256i z_y = _mm256_or_si256(_mm256_or_si256(_mm256_loadu_si256((__m256i*) &padded[y][z]), _mm256_loadu_si256((__m256i*) &padded[y][z + 2])),
+                                    _mm256_load_si256((__m256i*) &reach->rows[!y][z]));
+      __m256i grown = _mm256_and_si256(_mm256_or_si256(_mm256_or_si256(row, x), z_y), _mm256_load_si256((__m256i*) &free->rows[y][z]));
+      _mm256_store_si256((__m256i*) &next->rows[y][z], grown);
+      grew = _mm256_or_si256(grew, _mm256_xor_si256(grown, row));
+    }
+
+  return !_mm256_testz_si256(grew, grew);
+}
+#endif
+
+// Dilates from the cell until nothing grows, returns how many cells it reached
+// Kernels that weren't compiled in fall back to the next best one
+u32 reach_flood(Bitboard* free, i32 x, i32 y, i32 z, u8 kernel) {
+  if (kernel == FLOOD_BFS) return reach_bfs(free, x, y, z);
+  if (!(free->rows[y][z] >> x & 1)) return 0;
+
+  Bitboard boards[2] = { { .tiles = free->tiles }, { .tiles = free->tiles } };
+  u32 padded[2][REACH_ROWS + 8] = { 0 };
+  boards[0].rows[y][z] = 1u << x;
+  u8 current = 0, grew = 1;
+
+  while (grew) {
+    Bitboard* reach = &boards[current];
+    Bitboard* next = &boards[!current];
+    #ifdef REACH_AVX2
+    if (kernel == FLOOD_AVX2) grew = _reach_avx2(reach, next, free, padded); else
+    #endif
+    #ifdef REACH_SSE2
+    if (kernel >= FLOOD_SSE2) grew = _reach_sse2(reach, next, free, padded); else
+    #endif
+    grew = _reach_scalar(reach, next, free);
+    current = !current;
+  }
+
+  return bitboard_count(&boards[current]);
+}
+
+u8 reach_best_flood() {
+  #if defined(REACH_AVX2)
+  return FLOOD_AVX2;
+  #elif defined(REACH_SSE2)
+  return FLOOD_SSE2;
+  #else
+  return FLOOD_SCALAR;
+  #endif
+}
+
+// Free cells reachable from where the head would be after moving in dir, 0 if the move crashes
+u32 game_reach(Game* game, Bitboard* free, u8 dir) {
+  i8* head = game->snake.body[game->snake.size - 1];
+  if ((dir == FRONT && head[1] == 1) || (dir == BACK && head[1] == 0)) return 0;
+
+  i32 cell[3] = { head[0], head[1], head[2] };
+  game_step_head(cell, dir, game->tiles);
+  return reach_flood(free, cell[0], cell[1], cell[2], reach_best_flood());
+}
@@ -1,12 +1,34 @@
 #include "canvas.h"
+#include "snake.h"
+#include "trajectory.h"
+#include "snake_mesh.h"
+#include "arena.h"
+#include <pthread.h>
 #include <time.h>
 
-#define UPSCALE 0.3
+#define UPSCALE     0.3
+#define UPSCALE_MIN 0.2
+#define UPSCALE_MAX 0.6
 
-#define TICK_WAIT 0.4
-#define START_SIZE 3
-#define MAX_TILES 25
-#define TILES 10
+#define CHUNK 8
+#define SIM_POLL 0.001
+
+// Scripted scene of --gl-budget, a long snake with a third of it raised
+#define BUDGET_SIZE   60
+#define BUDGET_FRAMES 8
+
+// --bench draws the budget scene headless at every resolution and snake length asked for and prints the throughput of each
+#define BENCH_MAX    8
+#define BENCH_WARMUP 10
+#define BENCH_FRAMES 200
+
+// --arena N puts the player among N - 1 bots on a board with about ARENA_AREA cells per snake and an apple for every two
+#define ARENA_TICK 0.15
+
+GLStats gl_budget = {
+  .draws = 16, .uniforms = 32, .uploads = 10, .locations = 32,
+  .buffer_binds = 6, .vao_binds = 10, .texture_binds = 0, .programs = 3
+};
 
 u32 shader, hud_shader;
 
@@ -15,6 +37,11 @@ CanvasConfig config = {
   .fullscreen = 1,
   .screen_size = 1,
   .capture_mouse = 1,
+  .vsync = 1,
+  .width = 1280,
+  .height = 720,
+  .fps_cap = 144,
+  .idle_fps = 30,
   .clear_color = PASTEL_PURPLE
 };
 
@@ -27,62 +54,128 @@ Camera cam = {
 
 // ---
 
-enum { UP, RIGHT, DOWN, LEFT, FRONT, BACK } Direction;
+enum { SOUND_APPLE, SOUND_MOVE, SOUND_HIT, SOUND_DEATH, SOUND_START, SOUND_SONG, SOUND_AMOUNT } SoundName;
+enum { PASS_FLOOR, PASS_APPLE, PASS_SNAKE, PASS_SHADOW, PASS_OUTLINE, PASS_UPSCALE, PASS_HUD, PASS_AMOUNT } Pass;
 
+// The simulation runs on its own thread and owns the game, the renderer only sees the snapshots it publishes
+// With --record it also streams every tick played to shards, recording stays NULL otherwise
+// With --arena it steps the arena instead, which the renderer reads under arena_lock, arena stays NULL otherwise
 typedef struct {
-  i8 body[MAX_TILES * MAX_TILES * 2][3];
-  u8 size;
-  u8 dir;
-  u8 last_dir;
-  u8 last_plane_dir;
-} Snake;
+  Game game;
+  Snapshots snapshots;
+  InputQueue inputs;
+  atomic_uchar quit;
+  ShardStream* recording;
+  Arena* arena;
+  pthread_mutex_t arena_lock;
+} Sim;
+
+typedef struct {
+  u16 sizes[BENCH_MAX][2], lengths[BENCH_MAX];
+  u8 size_count, length_count, run;
+  u32 frame;
+  f64 start;
+} Bench;
 
 void key_callback(GLFWwindow* window, i32 key, i32 scancode, i32 action, i32 mods);
-void draw_shadow(Model* mo_shadow, u8 x, u8 y);
+void draw_overlay(FramePacer* pacer, SnakeMesh* mesh, Font font);
+u32 write_shadows(SnakeMesh* mesh, vec3* offsets);
+u32 write_arena_bodies(Arena* arena, TintedInstance* bodies);
+u32 write_arena_shadows(Arena* arena, vec3* offsets);
 f32 wave(f32 freq, f32 intensity, f32 delay);
 void cursor_callback(Camera* cam);
-void randomize_apple();
+f64 seconds();
+void* sim_thread(void* data);
+void* arena_thread(void* data);
+void play_events();
+void bench_parse(Bench* bench, c8* sizes, c8* lengths);
+u8 bench_step(Bench* bench);
+void resize_output(u16 width, u16 height);
+void set_render_scale(f32 scale);
 void lookat_center();
-void game_loop();
 
 // ---
 
-Snake snake = { { { TILES / 2, 0, TILES / 2 }, { TILES / 2 + 1, 0, TILES / 2 }, { TILES / 2 + 2, 0, TILES / 2 } }, 3, RIGHT, RIGHT, RIGHT };
-u8 apple[3];
+Sim sim;
+Game* game;
+u8 EVENT_SOUNDS[EVENT_AMOUNT] = { SOUND_APPLE, SOUND_MOVE, SOUND_HIT, SOUND_DEATH, SOUND_START };
+
+// The player's snake is the first, the bots cycle through the rest
+f32 ARENA_COLORS[][3] = { DEEP_PURPLE, DEEP_BLUE, DEEP_GREEN, DEEP_ORANGE, PURPLE, PASTEL_BLUE, PASTEL_PINK, GRAY };
 
 vec3 center = { TILES / 2.0, 0.5, TILES / 2.0 };
-f32 tick, last_tick, tick_wait = TICK_WAIT;
-u8 menu = 1, game_end = 0, tiles = TILES;
-f32 target_fov = PI4;
-vec3 target_pos = { TILES * 0.6, TILES * 1.5, TILES * 1.3 };
+u8 overlay = 0;
+f32 cull_ms;
+// The low resolution target is allocated for UPSCALE_MAX and the scene only uses lowres_w x lowres_h of it
+u32 lowres_fbo;
+u16 lowres_w, lowres_h;
+RenderScale render_scale = { UPSCALE, UPSCALE_MIN, UPSCALE_MAX };
+Capture capture;
+
+GpuTimer timers[PASS_AMOUNT] = { { "floor" }, { "apple" }, { "snake" }, { "shadow" }, { "outline" }, { "upscale" }, { "hud" } };
 
 // ---
 
-i32 main() {
-  canvas_init(&cam, config);
-  glfwSetKeyCallback(cam.window, key_callback);
+i32 main(i32 argc, c8** argv) {
+  u8 budget = 0;
+  u32 arena_snakes = 0;
+  Bench bench = { 0 };
+  c8 *bench_sizes = NULL, *bench_lengths = NULL, *capture_path = NULL, *record_prefix = NULL;
+  u8 capture_native = 0;
+
+  for (i32 i = 1; i < argc; i++) {
+    if      (!strcmp(argv[i], "--gl-budget")) budget = 1;
+    else if (!strcmp(argv[i], "--headless"))  config.headless = 1;
+    else if (!strcmp(argv[i], "--bench")   && i + 1 < argc) bench_sizes   = argv[++i];
+    else if (!strcmp(argv[i], "--lengths") && i + 1 < argc) bench_lengths = argv[++i];
+    else if (!strcmp(argv[i], "--capture") && i + 1 < argc) capture_path  = argv[++i];
+    else if (!strcmp(argv[i], "--record")  && i + 1 < argc) record_prefix = argv[++i];
+    else if (!strcmp(argv[i], "--arena")   && i + 1 < argc) arena_snakes  = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--capture-native")) capture_native = 1;
+    else ASSERT(0, "usage: %s [--gl-budget] [--headless] [--bench WxH,...] [--lengths N,...] [--capture file[.y4m]] [--capture-native] [--record prefix] [--arena N]", argv[0]);
+  }
+
+  // A capture keeps the size it started with, the bench resizes the output between runs
+  ASSERT(!bench_sizes || !capture_path, "--capture can't be used with --bench");
 
-  init_audio_engine((char*[16]) { "apple", "move", "hit", "death", "start", "song" }, 6);
-  set_volume("move",  0.07);
-  set_volume("death", 0.05);
-  set_volume("hit",   0.05);
+  if (bench_sizes) {
+    bench_parse(&bench, bench_sizes, bench_lengths);
+    config.headless = 1;
+    config.width  = bench.sizes[0][0];
+    config.height = bench.sizes[0][1];
+  }
+  u8 scripted = budget || bench.size_count;
+
+  f64 start = seconds();
+  TRACE_THREAD("main");
+
+  // Assets are parsed and decoded on workers while the window opens and shaders compile,
+  // each one is uploaded as soon as it's ready by jobs_finish
+  Jobs jobs;
+  jobs_start(&jobs);
+  assets_open("assets.pak");
+
+  init_audio_engine((SoundConfig[SOUND_AMOUNT]) {
+    [SOUND_APPLE] = { "apple", 2 },
+    [SOUND_MOVE]  = { "move",  2, .volume = 0.07 },
+    [SOUND_HIT]   = { "hit",   4, .volume = 0.05 },
+    [SOUND_DEATH] = { "death", 1, .volume = 0.05 },
+    [SOUND_START] = { "start", 1 },
+    [SOUND_SONG]  = { "song",  1, .stream = 1 }
+  }, SOUND_AMOUNT, &jobs);
 
   Material ma_floor   = { YELLOW,            .lig = 1 };
-  Material ma_shadow  = { { 0.7, 0.7, 0.2 }, .lig = 1 };
+  Material ma_shadow  = { SHADOW_YELLOW,     .lig = 1 };
   Material ma_snake   = { DEEP_PURPLE,       .lig = 1 };
   Material ma_apple   = { DEEP_RED,          .lig = 1 };
   Material ma_apple_h = { DEEP_RED,          .lig = 1, .tex = GL_TEXTURE1 };
 
-  Model* mo_floor   = model_create("cube", &ma_floor,  1);
-  Model* mo_shadow  = model_create("cube", &ma_shadow, 1);
-  Model* mo_snake   = model_create("cube", &ma_snake,  1);
-  Model* mo_apple   = model_create("cube", &ma_apple,  1);
-  Model* mo_apple_h = model_create("cube", &ma_apple_h, 1);
-
-  Font font = { GL_TEXTURE0, 30, 5, 7.0 / 5 };
+  Model* mo_floor = model_load(&jobs, "cube", &ma_floor, 1);
+  canvas_load_texture(&jobs, GL_TEXTURE0, "font",   TEXTURE_DEFAULT);
+  canvas_load_texture(&jobs, GL_TEXTURE1, "hidden", TEXTURE_DEFAULT);
 
-  canvas_create_texture(GL_TEXTURE0, "font",   TEXTURE_DEFAULT);
-  canvas_create_texture(GL_TEXTURE1, "hidden", TEXTURE_DEFAULT);
+  canvas_init(&cam, config);
+  glfwSetKeyCallback(cam.window, key_callback);
 
   shader = shader_create_program("obj");
   generate_proj_mat(&cam, shader);
@@ -91,98 +184,321 @@ i32 main() {
   hud_shader = shader_create_program("hud");
   generate_ortho_mat(&cam, hud_shader);
 
+  SnakeMesh* me_snake = snake_mesh_create(MAX_TILES * MAX_TILES * 2, MAX_TILES, CHUNK, &ma_snake);
+  jobs_finish(&jobs);
+  jobs_stop(&jobs);
+
+  // Every cube is the same mesh, parsed and uploaded once
+  Model* mo_shadow  = model_share(mo_floor, &ma_shadow);
+  Model* mo_apple   = model_share(mo_floor, &ma_apple);
+  Model* mo_apple_h = model_share(mo_floor, &ma_apple_h);
+  Model* mo_body    = model_share(mo_floor, &ma_snake);
+
+  Font font = { GL_TEXTURE0, 30, 5, 7.0 / 5 };
+  Font small_font = { GL_TEXTURE0, 12, 2, 7.0 / 5 };
+
   // FBO
-  u32 lowres_fbo = canvas_create_FBO(cam.width * UPSCALE, cam.height * UPSCALE, GL_NEAREST, GL_NEAREST);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  lowres_fbo = canvas_create_FBO(cam.width * render_scale.max, cam.height * render_scale.max, GL_NEAREST, GL_NEAREST, 1);
+  glBindFramebuffer(GL_FRAMEBUFFER, cam.FBO);
+  set_render_scale(UPSCALE);
+  // Under vsync a frame can't come sooner than the monitor's refresh, whatever the cap
+  render_scale.budget_ms = 1000 / (cam.refresh ? MIN(cam.refresh, config.fps_cap) : config.fps_cap);
+
+  // Captures the low resolution scene, which is cheap to read back, or the final frame with the HUD
+  if (capture_path) {
+    if (capture_native) canvas_capture_start(&capture, capture_path, cam.width, cam.height, config.fps_cap);
+    else canvas_capture_start(&capture, capture_path, lowres_w, lowres_h, config.fps_cap);
+  }
 
   // ---
 
-  srand(time(0));
-  randomize_apple();
-  play_audio_loop("song");
+  game_init(&sim.game, time(0));
+  if (budget) game_budget_scene(&sim.game, BUDGET_SIZE);
+
+  // The arena takes the game's place, which leaves the menu so frames are paced and scaled like when playing
+  // The stream is sized before its first use for every cell of the board and a shadow under half of them
+  Arena arena;
+  if (arena_snakes && !scripted) {
+    arena_init(&arena, arena_tiles(arena_snakes), arena_snakes, arena_snakes / 2, time(0));
+    pthread_mutex_init(&sim.arena_lock, NULL);
+    sim.arena = &arena;
+    sim.game.menu = 0;
+    STREAM.size = STREAM_SIZE + arena.cells * 2 * sizeof(TintedInstance);
+
+    cam.far_plane = arena.tiles * 4;
+    glm_vec3_copy((vec3) { arena.tiles * 0.6, arena.tiles * 1.5, arena.tiles * 1.3 }, cam.pos);
+    glm_vec3_copy((vec3) { arena.tiles / 2.0, 0.5, arena.tiles / 2.0 }, center);
+    canvas_use_program(shader);
+    generate_proj_mat(&cam, shader);
+  }
+
+  snapshots_init(&sim.snapshots);
+  snapshots_publish(&sim.snapshots, &sim.game);
+
+  // The stream opens on the first tick played, the game starts in the menu
+  ShardWriter writer;
+  ShardStream recording = { .writer = &writer };
+  if (record_prefix && !scripted && !sim.arena) {
+    shard_writer_start(&writer, record_prefix, 1);
+    sim.recording = &recording;
+  }
+
+  // --gl-budget and --bench draw fixed scenes, so they have nothing to simulate
+  pthread_t sim_id;
+  if (!scripted) pthread_create(&sim_id, NULL, sim.arena ? arena_thread : sim_thread, NULL);
+  play_audio_loop(SOUND_SONG);
+
+  FramePacer pacer = { 0 };
+  RenderQueue queue = { 0 };
+  #ifdef CANVAS_GL_STATS
+  gl_stats_open("gl_stats.csv");
+  #endif
 
   while (!glfwWindowShouldClose(cam.window)) {
-    tick = glfwGetTime();
-    if (tick - last_tick > tick_wait) {
-      last_tick = tick;
-      game_loop();
-    }
+    TRACE_BEGIN("frame");
+    f64 frame_start = glfwGetTime();
+    if (bench.size_count && !bench_step(&bench)) break;
+    game = snapshots_read(&sim.snapshots);
+    play_events();
 
     cam.pos[0] -= sin(glfwGetTime() * PI / 6) * 0.003;
     cam.pos[1] -= sin(glfwGetTime() * PI / 4) * 0.020;
     cam.pos[2] += sin(glfwGetTime() * PI / 9) * 0.007;
 
-    if (center[0]  < tiles / 2.0)   center[0] += 0.001;
-    if (center[2]  < tiles / 2.0)   center[2] += 0.001;
-    if (cam.fov    < target_fov)    cam.fov   += 0.001;
-    if (cam.pos[0] < target_pos[0]) cam.pos[0] += 0.01;
-    if (cam.pos[1] < target_pos[1]) cam.pos[1] += 0.01;
-    if (cam.pos[2] < target_pos[2]) cam.pos[2] += 0.01;
+    if (center[0]  < game->tiles / 2.0)   center[0] += 0.001;
+    if (center[2]  < game->tiles / 2.0)   center[2] += 0.001;
+    if (cam.fov    < game->target_fov)    cam.fov   += 0.001;
+    if (cam.pos[0] < game->target_pos[0]) cam.pos[0] += 0.01;
+    if (cam.pos[1] < game->target_pos[1]) cam.pos[1] += 0.01;
+    if (cam.pos[2] < game->target_pos[2]) cam.pos[2] += 0.01;
+
+    // The scene is shaded at low resolution, only the HUD is drawn at native size
+    TRACE_BEGIN("scene");
+    glBindFramebuffer(GL_FRAMEBUFFER, lowres_fbo);
+    glViewport(0, 0, lowres_w, lowres_h);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // The size the HUD shows, in the arena it's the player's, copied while the arena is locked
+    u32 score = game->snake.size;
+    if (sim.arena) {
+      canvas_use_program(shader);
+      lookat_center();
+      mat4 transform;
+      u32 offset, count;
+
+      // Every snake, apple and shadow goes in one instanced draw each, from a single read of the arena
+      pthread_mutex_lock(&sim.arena_lock);
+      Arena* arena = sim.arena;
+      score = arena->snakes[0].size;
 
-    if (!menu) {
+      // Floor
+      gpu_timer_begin(&timers[PASS_FLOOR]);
+      glm_mat4_identity(transform);
+      glm_scale(transform, (vec3) { arena->tiles, 1, arena->tiles });
+      render_queue_push(&queue, shader, mo_floor, ma_floor, transform);
+      render_queue_submit(&queue);
+      gpu_timer_end(&timers[PASS_FLOOR]);
+
+      // Apples
+      gpu_timer_begin(&timers[PASS_APPLE]);
+      if (arena->apple_count) {
+        vec3* apples = canvas_stream_map(&STREAM, arena->apple_count * sizeof(vec3), sizeof(vec3), &offset);
+        for (u32 i = 0; i < arena->apple_count; i++) {
+          u8 cell[3];
+          arena_position(arena, arena->apples[i], cell);
+          glm_vec3_copy((vec3) { cell[0], cell[1] + 1, cell[2] }, apples[i]);
+        }
+        canvas_stream_unmap(&STREAM);
+        canvas_set_material(shader, ma_apple);
+        glm_mat4_identity(mo_apple->model);
+        model_draw_instanced(mo_apple, shader, &STREAM, offset, arena->apple_count);
+      }
+      gpu_timer_end(&timers[PASS_APPLE]);
+
+      // Snakes
+      gpu_timer_begin(&timers[PASS_SNAKE]);
+      if ((count = write_arena_bodies(arena, NULL))) {
+        write_arena_bodies(arena, canvas_stream_map(&STREAM, count * sizeof(TintedInstance), sizeof(TintedInstance), &offset));
+        canvas_stream_unmap(&STREAM);
+        canvas_set_material(shader, ma_snake);
+        glm_mat4_identity(mo_body->model);
+        model_draw_tinted(mo_body, shader, &STREAM, offset, count);
+      }
+      gpu_timer_end(&timers[PASS_SNAKE]);
+
+      // Shadows
+      gpu_timer_begin(&timers[PASS_SHADOW]);
+      if ((count = write_arena_shadows(arena, NULL))) {
+        write_arena_shadows(arena, canvas_stream_map(&STREAM, count * sizeof(vec3), sizeof(vec3), &offset));
+        canvas_stream_unmap(&STREAM);
+        canvas_set_material(shader, ma_shadow);
+        glm_mat4_identity(mo_shadow->model);
+        glm_scale(mo_shadow->model, (vec3) { 1, 0, 1 });
+        model_draw_instanced(mo_shadow, shader, &STREAM, offset, count);
+      }
+      gpu_timer_end(&timers[PASS_SHADOW]);
+
+      pthread_mutex_unlock(&sim.arena_lock);
+    }
+    else if (!game->menu) {
+      canvas_use_program(shader);
       lookat_center();
+      mat4 transform;
 
-      // 3D Drawing
-      glUseProgram(shader);
+      // 3D Drawing, each pass is sorted and submitted on its own so it can be timed
 
       // Floor
-      model_bind(mo_floor, shader);
-      glm_scale(mo_floor->model, (vec3) { tiles, 1, tiles });
-      model_draw(mo_floor, shader);
+      gpu_timer_begin(&timers[PASS_FLOOR]);
+      glm_mat4_identity(transform);
+      glm_scale(transform, (vec3) { game->tiles, 1, game->tiles });
+      render_queue_push(&queue, shader, mo_floor, ma_floor, transform);
+      render_queue_submit(&queue);
+      gpu_timer_end(&timers[PASS_FLOOR]);
 
       // Apple
-      model_bind(mo_apple, shader);
-      glm_translate(mo_apple->model, (vec3) { apple[0], apple[1] + 1, apple[2] });
-      model_draw(mo_apple, shader);
-
-      if (apple[1]) draw_shadow(mo_shadow, apple[0], apple[2]);
+      gpu_timer_begin(&timers[PASS_APPLE]);
+      glm_mat4_identity(transform);
+      glm_translate(transform, (vec3) { game->apple[0], game->apple[1] + 1, game->apple[2] });
+      render_queue_push(&queue, shader, mo_apple, ma_apple, transform);
+      render_queue_submit(&queue);
+      gpu_timer_end(&timers[PASS_APPLE]);
 
       // Snake
-      for (u8 i = 0; i < snake.size; i++) {
-        model_bind(mo_snake, shader);
-        canvas_uni3f(shader, "MAT.COL", ma_snake.col[0] - (snake.size - i) * 0.003, ma_snake.col[1] - (snake.size - i) * 0.003, ma_snake.col[2] - (snake.size - i) * 0.003);
-        glm_translate(mo_snake->model, (vec3) { snake.body[i][0], snake.body[i][1] + 1, snake.body[i][2] });
-        model_draw(mo_snake, shader);
-
-        if (snake.body[i][1]) draw_shadow(mo_shadow, snake.body[i][0], snake.body[i][2]);
+      gpu_timer_begin(&timers[PASS_SNAKE]);
+      snake_mesh_update(me_snake, game->snake.body, game->snake.size);
+
+      // Chunks of the body outside the view are skipped along with their shadows
+      f64 cull_start = glfwGetTime();
+      vec4 planes[6];
+      canvas_frustum_planes(&cam, planes);
+      snake_mesh_cull(me_snake, planes);
+      cull_ms = (glfwGetTime() - cull_start) * 1000;
+
+      if (game->snake.size) {
+        // Segments darken towards the tail, the gradient starts one step past the head
+        Material ma_body = ma_snake;
+        ma_body.grd = 0.003;
+        ma_body.org = snake_mesh_head_serial(me_snake) + 1;
+        glm_mat4_identity(transform);
+        snake_mesh_queue(me_snake, &queue, shader, ma_body, transform);
+      }
+      render_queue_submit(&queue);
+      gpu_timer_end(&timers[PASS_SNAKE]);
+
+      // Shadows
+      gpu_timer_begin(&timers[PASS_SHADOW]);
+      u32 shadows = write_shadows(me_snake, NULL), offset;
+      if (shadows) {
+        write_shadows(me_snake, canvas_stream_map(&STREAM, shadows * sizeof(vec3), sizeof(vec3), &offset));
+        canvas_stream_unmap(&STREAM);
+        canvas_set_material(shader, ma_shadow);
+        glm_mat4_identity(mo_shadow->model);
+        glm_scale(mo_shadow->model, (vec3) { 1, 0, 1 });
+        model_draw_instanced(mo_shadow, shader, &STREAM, offset, shadows);
       }
+      gpu_timer_end(&timers[PASS_SHADOW]);
 
       // Apple Outline
+      gpu_timer_begin(&timers[PASS_OUTLINE]);
       glDisable(GL_DEPTH_TEST);
-      model_bind(mo_apple_h, shader);
-      glm_mat4_copy(mo_apple->model, mo_apple_h->model);
-      model_draw(mo_apple_h, shader);
+      glm_mat4_identity(transform);
+      glm_translate(transform, (vec3) { game->apple[0], game->apple[1] + 1, game->apple[2] });
+      render_queue_push(&queue, shader, mo_apple_h, ma_apple_h, transform);
+      render_queue_submit(&queue);
       glEnable(GL_DEPTH_TEST);
+      gpu_timer_end(&timers[PASS_OUTLINE]);
     }
 
-    // Lowres
-    glBlitNamedFramebuffer(0, lowres_fbo, 0, 0, cam.width, cam.height, 0, 0, cam.width * UPSCALE, cam.height * UPSCALE, GL_COLOR_BUFFER_BIT, GL_NEAREST);
-    glBlitNamedFramebuffer(lowres_fbo, 0, 0, 0, cam.width * UPSCALE, cam.height * UPSCALE, 0, 0, cam.width, cam.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    TRACE_END();
+    if (capture_path && !capture_native) canvas_capture_frame(&capture, lowres_fbo);
+
+    // Upscale
+    TRACE_BEGIN("upscale");
+    gpu_timer_begin(&timers[PASS_UPSCALE]);
+    canvas_blit_FBO(lowres_fbo, cam.FBO, lowres_w, lowres_h, cam.width, cam.height);
+    glBindFramebuffer(GL_FRAMEBUFFER, cam.FBO);
+    glViewport(0, 0, cam.width, cam.height);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    gpu_timer_end(&timers[PASS_UPSCALE]);
+    TRACE_END();
 
     // HUD Drawing
-    glUseProgram(hud_shader);
+    TRACE_BEGIN("hud");
+    gpu_timer_begin(&timers[PASS_HUD]);
+    canvas_use_program(hud_shader);
 
     // Draw Text
-    if (menu) {
+    if (game->menu) {
       hud_draw_text(hud_shader, "snakinator", cam.width / 2.0 - canvas_text_width("snakinator", font, 1) / 2.0 + wave(8, 15, 0.00), cam.height / 2.0 - font.size / 2.0 + wave(9, 12, 0.00), font, (vec3) PASTEL_GREEN);
       hud_draw_text(hud_shader, "snakinator", cam.width / 2.0 - canvas_text_width("snakinator", font, 1) / 2.0 + wave(8, 15, 0.06), cam.height / 2.0 - font.size / 2.0 + wave(9, 12, 0.06), font, (vec3) DEEP_GREEN);
     }
     else {
       char buffer[16];
-      sprintf(buffer, "%d", snake.size);
+      sprintf(buffer, "%u", score);
       hud_draw_text(hud_shader, buffer, 20 + wave(8, 6, 0.00), 20 + wave(9, 4, 0.00), font, (vec3) DEEP_PURPLE);
       hud_draw_text(hud_shader, buffer, 20 + wave(8, 6, 0.04), 20 + wave(9, 4, 0.04), font, (vec3) DEEP_PURPLE);
     }
+    gpu_timer_end(&timers[PASS_HUD]);
+
+    update_fps(&cam);
+    if (overlay) draw_overlay(&pacer, me_snake, small_font);
+    TRACE_END();
+    if (capture_path && capture_native) canvas_capture_frame(&capture, cam.FBO);
 
-    // Finish
-    glUseProgram(shader);
+    // Finish, the CPU time is taken before the swap, which waits for vsync
+    f32 cpu_ms = (glfwGetTime() - frame_start) * 1000;
+    TRACE_BEGIN("glfwSwapBuffers");
     glfwSwapBuffers(cam.window);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    TRACE_END();
+    if (start) PRINT("Time to first frame %.2fms", (seconds() - start) * 1000);
+    start = 0;
+    TRACE_BEGIN("glfwPollEvents");
     glfwPollEvents();
+    TRACE_END();
     cursor_callback(&cam);
+    canvas_stream_fence(&STREAM);
+
+    // Nothing but the title moves on the menu, so there's no point drawing it at full rate
+    u8 idle = game->menu || (!config.headless && !glfwGetWindowAttrib(cam.window, GLFW_FOCUSED));
+    gl_stats_frame();
+
+    // Fixed scenes and captures keep their size, the menu draws no scene to time
+    if (!scripted && !capture_path && !game->menu) {
+      f32 gpu_ms = 0;
+      for (u8 i = 0; i < PASS_AMOUNT; i++) gpu_ms += timers[i].ms;
+      if (canvas_render_scale(&render_scale, MAX(gpu_ms, cpu_ms))) set_render_scale(render_scale.scale);
+    }
+    if (budget && pacer.count == BUDGET_FRAMES) break;
+
+    TRACE_BEGIN("pace");
+    canvas_pace_frame(&pacer, bench.size_count ? 0 : idle ? config.idle_fps : config.fps_cap);
+    TRACE_END();
+    TRACE_END();
+  }
+
+  atomic_store(&sim.quit, 1);
+  if (!scripted) pthread_join(sim_id, NULL);
+
+  if (sim.recording) {
+    u64 steps = recording.steps;
+    if (recording.buffer) shard_stream_close(&recording);
+    shard_writer_stop(&writer);
+    PRINT("Recorded %llu transitions into %u shards", (unsigned long long) steps, writer.shards);
   }
 
+  PRINT("Frame time %.2fms, jitter %.2fms, worst %.2fms", pacer.mean, pacer.jitter, pacer.worst);
+  if (capture_path) {
+    canvas_capture_stop(&capture);
+    PRINT("Captured %u frames, dropped %u, latency %.2fms, worst %.2fms", capture.captured, capture.dropped, capture.latency, capture.worst_latency);
+  }
+  TRACE_DUMP("trace.json");
   glfwTerminate();
+
+  #ifdef CANVAS_GL_STATS
+  if (budget) return !gl_stats_check(gl_stats_last, gl_budget);
+  #else
+  if (budget) PRINT("GL stats are disabled, build with SNAKINATOR_GL_STATS");
+  #endif
   return 0;
 }
 
@@ -190,11 +506,117 @@ f32 wave(f32 freq, f32 intensity, f32 delay) {
   return sin((glfwGetTime() - delay) * freq) * intensity;
 }
 
-void draw_shadow(Model* mo_shadow, u8 x, u8 y) {
-  model_bind(mo_shadow, shader);
-  glm_translate(mo_shadow->model, (vec3) { x, 1.01, y });
-  glm_scale(mo_shadow->model, (vec3) { 1, 0, 1 });
-  model_draw(mo_shadow, shader);
+void draw_overlay(FramePacer* pacer, SnakeMesh* mesh, Font font) {
+  char buffer[64];
+  f32 line = font.size * font.ratio + 4;
+  f32 y = cam.height - 20 - line;
+
+  sprintf(buffer, "fps %.0f", cam.fps);
+  hud_draw_text(hud_shader, buffer, 20, y, font, (vec3) BLACK);
+  sprintf(buffer, "frame %.2fms +-%.2f", pacer->mean, pacer->jitter);
+  hud_draw_text(hud_shader, buffer, 20, y -= line, font, (vec3) BLACK);
+
+  for (u8 i = 0; i < PASS_AMOUNT; i++) {
+    sprintf(buffer, "%-8s %.3fms", timers[i].name, timers[i].ms);
+    hud_draw_text(hud_shader, buffer, 20, y -= line, font, (vec3) BLACK);
+  }
+
+  sprintf(buffer, "cull %.3fms chunks %u culled %u", cull_ms, mesh->visible_chunks, mesh->culled_chunks);
+  hud_draw_text(hud_shader, buffer, 20, y -= line, font, (vec3) BLACK);
+  sprintf(buffer, "stream %.1fkb stalls %u", STREAM.frame_bytes / 1024.0, STREAM.stalls);
+  hud_draw_text(hud_shader, buffer, 20, y -= line, font, (vec3) BLACK);
+
+  sprintf(buffer, "scale %.2f %ux%u", render_scale.scale, lowres_w, lowres_h);
+  hud_draw_text(hud_shader, buffer, 20, y -= line, font, (vec3) BLACK);
+
+  if (sim.arena) {
+    pthread_mutex_lock(&sim.arena_lock);
+    sprintf(buffer, "arena %u/%u alive apples %u deaths %u", sim.arena->alive, sim.arena->count, sim.arena->apple_count, sim.arena->events[EVENT_DEATH]);
+    pthread_mutex_unlock(&sim.arena_lock);
+    hud_draw_text(hud_shader, buffer, 20, y -= line, font, (vec3) BLACK);
+  }
+
+  if (capture.file) {
+    u32 captured;
+    f64 latency;
+    canvas_capture_stats(&capture, &captured, &latency);
+    sprintf(buffer, "capture %u dropped %u latency %.1fms", captured, capture.dropped, latency);
+    hud_draw_text(hud_shader, buffer, 20, y -= line, font, (vec3) BLACK);
+  }
+
+  #ifdef CANVAS_GL_STATS
+  sprintf(buffer, "draws %u uniforms %u uploads %u", gl_stats_last.draws, gl_stats_last.uniforms, gl_stats_last.uploads);
+  hud_draw_text(hud_shader, buffer, 20, y -= line, font, (vec3) BLACK);
+  sprintf(buffer, "binds %u programs %u", gl_stats_last.buffer_binds + gl_stats_last.vao_binds + gl_stats_last.texture_binds, gl_stats_last.programs);
+  hud_draw_text(hud_shader, buffer, 20, y -= line, font, (vec3) BLACK);
+  #endif
+}
+
+// Shadows are flat cubes under everything on the upper layer in view, returns their amount and writes them if asked
+u32 write_shadows(SnakeMesh* mesh, vec3* offsets) {
+  u32 shadows = 0;
+  if (game->apple[1]) {
+    if (offsets) glm_vec3_copy((vec3) { game->apple[0], 1.01, game->apple[2] }, offsets[shadows]);
+    shadows++;
+  }
+
+  Snake* snake = &game->snake;
+  for (u8 i = 0; i < snake->size; i++)
+    if (snake->body[i][1] && snake_mesh_visible(mesh, snake->body[i])) {
+      if (offsets) glm_vec3_copy((vec3) { snake->body[i][0], 1.01, snake->body[i][2] }, offsets[shadows]);
+      shadows++;
+    }
+
+  return shadows;
+}
+
+// Every cell of the living snakes, in the snake's color darkening towards its tail, returns their amount and writes them if asked
+u32 write_arena_bodies(Arena* arena, TintedInstance* bodies) {
+  u32 count = 0;
+  for (u32 i = 0; i < arena->count; i++) {
+    ArenaSnake* snake = &arena->snakes[i];
+    if (!snake->alive) continue;
+    if (!bodies) {
+      count += snake->size;
+      continue;
+    }
+
+    f32* color = ARENA_COLORS[i ? 1 + (i - 1) % (LEN(ARENA_COLORS) - 1) : 0];
+    for (u32 j = 0; j < snake->size; j++) {
+      u8 cell[3];
+      f32 shade = 0.4 + 0.6 * (j + 1) / snake->size;
+      arena_position(arena, arena_body(snake, j), cell);
+      bodies[count++] = (TintedInstance) {
+        { cell[0], cell[1] + 1, cell[2] }, 0,
+        { color[0] * shade * 255, color[1] * shade * 255, color[2] * shade * 255, 0 }
+      };
+    }
+  }
+
+  return count;
+}
+
+// Shadows under every apple and body cell on the upper layer, like write_shadows, nothing is culled here
+u32 write_arena_shadows(Arena* arena, vec3* offsets) {
+  u32 shadows = 0, layer = arena->cells / 2;
+  for (u32 i = 0; i < arena->apple_count; i++)
+    if (arena->apples[i] >= layer) {
+      if (offsets) glm_vec3_copy((vec3) { arena->apples[i] % arena->tiles, 1.01, arena->apples[i] / arena->tiles % arena->tiles }, offsets[shadows]);
+      shadows++;
+    }
+
+  for (u32 i = 0; i < arena->count; i++) {
+    ArenaSnake* snake = &arena->snakes[i];
+    if (!snake->alive) continue;
+    for (u32 j = 0; j < snake->size; j++) {
+      u32 cell = arena_body(snake, j);
+      if (cell < layer) continue;
+      if (offsets) glm_vec3_copy((vec3) { cell % arena->tiles, 1.01, cell / arena->tiles % arena->tiles }, offsets[shadows]);
+      shadows++;
+    }
+  }
+
+  return shadows;
 }
 
 void lookat_center() {
@@ -205,44 +627,43 @@ void lookat_center() {
 void key_callback(GLFWwindow *window, i32 key, i32 scancode, i32 action, i32 mods) {
   if (action != GLFW_PRESS) return;
 
-  if (menu && key != GLFW_KEY_ESCAPE) {
-    menu = 0;
-    play_audio("start");
+  if (key == GLFW_KEY_F3) {
+    overlay = !overlay;
+    return;
+  }
+
+  // Quitting is the only key handled here, everything else goes to the sim, the arena has no menu to go back to
+  if (key == GLFW_KEY_ESCAPE && (game->menu || sim.arena)) {
+    glfwSetWindowShouldClose(window, 1);
+    return;
   }
 
+  u8 input;
   switch (key) {
-    case GLFW_KEY_ESCAPE: 
-      if (menu) glfwSetWindowShouldClose(window, 1); 
-      else menu = 1; 
-      return;
-
-    case GLFW_KEY_S: if (snake.last_dir !=  DOWN) { snake.dir =    UP; last_tick -= 0.5; } break;
-    case GLFW_KEY_W: if (snake.last_dir !=    UP) { snake.dir =  DOWN; last_tick -= 0.5; } break;
-    case GLFW_KEY_D: if (snake.last_dir !=  LEFT) { snake.dir = RIGHT; last_tick -= 0.5; } break;
-    case GLFW_KEY_A: if (snake.last_dir != RIGHT) { snake.dir =  LEFT; last_tick -= 0.5; } break;
-
-    case GLFW_KEY_E:
-      if      (snake.body[snake.size - 1][1] == 0 && snake.last_dir !=  BACK) { snake.dir = FRONT; last_tick -= 0.5; }
-      else if (snake.body[snake.size - 1][1] == 1 && snake.last_dir != FRONT) { snake.dir =  BACK; last_tick -= 0.5; }
-      break;
-
-    default: return;
+    case GLFW_KEY_ESCAPE: input = INPUT_MENU;  break;
+    case GLFW_KEY_S:      input = INPUT_UP;    break;
+    case GLFW_KEY_W:      input = INPUT_DOWN;  break;
+    case GLFW_KEY_D:      input = INPUT_RIGHT; break;
+    case GLFW_KEY_A:      input = INPUT_LEFT;  break;
+    case GLFW_KEY_E:      input = INPUT_LAYER; break;
+    default:              input = INPUT_OTHER; break;
   }
 
-  
+  input_push(&sim.inputs, input);
 }
 
 void cursor_callback(Camera* cam) {
   static vec2 mouse;
   f64 x, y;
   glfwGetCursorPos(cam->window, &x, &y);
+  f32 tiles = sim.arena ? sim.arena->tiles : game->tiles;
 
   if (!mouse[0]) { mouse[0] = x; mouse[1] = y; }
   if (x == mouse[0] && y == mouse[1]) return;
 
-  cam->pos[0] -= 0.010 * (x - mouse[0]) * ((f32) tiles / TILES);
-  cam->pos[1] -= 0.001 * (y - mouse[1]) * ((f32) tiles / TILES);
-  cam->pos[2] += 0.010 * (y - mouse[1]) * ((f32) tiles / TILES);
+  cam->pos[0] -= 0.010 * (x - mouse[0]) * (tiles / TILES);
+  cam->pos[1] -= 0.001 * (y - mouse[1]) * (tiles / TILES);
+  cam->pos[2] += 0.010 * (y - mouse[1]) * (tiles / TILES);
 
   mouse[0] = x;
   mouse[1] = y;
@@ -250,93 +671,166 @@ void cursor_callback(Camera* cam) {
 
 // ---
 
-void randomize_apple() {
-  apple[0] = RAND(0, tiles);
-  apple[1] = RAND(0, 2);
-  apple[2] = RAND(0, tiles);
- 
-  for (u8 i = 0; i < snake.size; i++)
-    if (VEC3_COMPARE(snake.body[i], apple)) 
-      randomize_apple();
+// Sizes come as "WxH,WxH", lengths as "N,N", the budget scene's length when there are none
+void bench_parse(Bench* bench, c8* sizes, c8* lengths) {
+  for (c8* size = strtok(sizes, ","); size && bench->size_count < BENCH_MAX; size = strtok(NULL, ",")) {
+    u16* out = bench->sizes[bench->size_count++];
+    ASSERT(sscanf(size, "%hux%hu", &out[0], &out[1]) == 2 && out[0] && out[1], "Bad bench size (%s)", size);
+  }
+
+  for (c8* length = lengths ? strtok(lengths, ",") : NULL; length && bench->length_count < BENCH_MAX; length = strtok(NULL, ",")) {
+    i32 value = atoi(length);
+    ASSERT(value >= START_SIZE && value <= 255, "Bench lengths go from %d to 255 (%s)", START_SIZE, length);
+    bench->lengths[bench->length_count++] = value;
+  }
+
+  if (!bench->length_count) bench->lengths[bench->length_count++] = BUDGET_SIZE;
 }
 
-void game_loop() {
-  if (menu) return;
+// Called before each frame, sets each run up and reports it once measured, returns 0 after the last one
+u8 bench_step(Bench* bench) {
+  u8 lengths = bench->length_count;
 
-  if (game_end) {
-    if (!snake.size && tick_wait == TICK_WAIT * 5) {
-      for (u8 i = 0; i < START_SIZE; i++) {
-        snake.body[i][0] = snake.body[game_end - 3 + i][0];
-        snake.body[i][1] = snake.body[game_end - 3 + i][1];
-        snake.body[i][2] = snake.body[game_end - 3 + i][2];
-      }
+  if (bench->frame == BENCH_WARMUP) {
+    glFinish();
+    bench->start = seconds();
+  }
+
+  if (bench->frame == BENCH_WARMUP + BENCH_FRAMES) {
+    glFinish();
+    f64 elapsed = seconds() - bench->start;
+    u16* size = bench->sizes[bench->run / lengths];
+    PRINT("bench %ux%u length %u: %.1f fps, %.3fms", size[0], size[1], bench->lengths[bench->run % lengths], BENCH_FRAMES / elapsed, elapsed * 1000 / BENCH_FRAMES);
+    bench->run++;
+    bench->frame = 0;
+  }
+
+  if (bench->run == bench->size_count * lengths) return 0;
 
-      tick_wait = TICK_WAIT;
-      snake.size = START_SIZE;
-      game_end = 0;
-      play_audio("start");
+  if (!bench->frame) {
+    u16* size = bench->sizes[bench->run / lengths];
+    if (size[0] != cam.width || size[1] != cam.height) resize_output(size[0], size[1]);
+    game_budget_scene(&sim.game, bench->lengths[bench->run % lengths]);
+    snapshots_publish(&sim.snapshots, &sim.game);
+  }
+
+  bench->frame++;
+  return 1;
+}
+
+void resize_output(u16 width, u16 height) {
+  canvas_resize(&cam, width, height);
+  canvas_delete_FBO(lowres_fbo);
+  lowres_fbo = canvas_create_FBO(width * render_scale.max, height * render_scale.max, GL_NEAREST, GL_NEAREST, 1);
+  set_render_scale(render_scale.scale);
+
+  canvas_use_program(shader);
+  generate_proj_mat(&cam, shader);
+  canvas_use_program(hud_shader);
+  generate_ortho_mat(&cam, hud_shader);
+}
+
+// Wall clock, unlike glfwGetTime it works before glfwInit
+f64 seconds() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void set_render_scale(f32 scale) {
+  lowres_w = MAX(cam.width  * scale, 1);
+  lowres_h = MAX(cam.height * scale, 1);
+}
+
+void* sim_thread(void* data) {
+  TRACE_THREAD("sim");
+  f64 last_tick = 0;
+
+  u8 action = INPUT_OTHER;
+
+  while (!atomic_load(&sim.quit)) {
+    u8 input, changed = 0;
+    while (input_pop(&sim.inputs, &input)) {
+      if (game_input(&sim.game, input)) last_tick -= 0.5;
+      action = input;
+      changed = 1;
     }
-    else if (!snake.size) tick_wait = TICK_WAIT * 5;
-    else {
-      snake.size--;
-      tick_wait *= 0.95;
-      stop_audio("hit");
-      play_audio("hit");
+
+    f64 tick = glfwGetTime();
+    if (tick - last_tick > sim.game.tick_wait) {
+      last_tick = tick;
+      u32 apples = sim.game.events[EVENT_APPLE], deaths = sim.game.events[EVENT_DEATH];
+      u8 played = !sim.game.menu, ending = sim.game.game_end != 0;
+      if (played && sim.recording && !sim.recording->buffer) shard_stream_open(sim.recording, sim.recording->writer, 0, &sim.game);
+
+      TRACE_BEGIN("game_step");
+      game_step(&sim.game);
+      TRACE_END();
+      changed = 1;
+
+      // The last input before the tick is its action, INPUT_OTHER when there was none
+      if (played && sim.recording) {
+        u8 done = sim.game.events[EVENT_DEATH] != deaths;
+        shard_stream_step(sim.recording, action, done ? -1 : sim.game.events[EVENT_APPLE] != apples, done, ending, &sim.game);
+      }
+      action = INPUT_OTHER;
     }
-    return;
-  }
 
-  // If going to hit a border on y-axis, get back to a plane direction
-  if (snake.dir == FRONT && snake.body[snake.size - 1][1] == 1 || snake.dir == BACK && snake.body[snake.size - 1][1] == 0)
-    snake.dir = snake.last_plane_dir;
-
-  // Create the new head outbound before shifting the snake
-  snake.body[snake.size][0] = snake.body[snake.size - 1][0];
-  snake.body[snake.size][1] = snake.body[snake.size - 1][1];
-  snake.body[snake.size][2] = snake.body[snake.size - 1][2];
-
-  switch (snake.dir) {
-    case UP:    snake.body[snake.size][2]++; break;
-    case DOWN:  snake.body[snake.size][2]--; break;
-    case RIGHT: snake.body[snake.size][0]++; break;
-    case LEFT:  snake.body[snake.size][0]--; break;
-    case FRONT: snake.body[snake.size][1]++; break;
-    case BACK:  snake.body[snake.size][1]--; break;
+    if (changed) snapshots_publish(&sim.snapshots, &sim.game);
+
+    // Sleeps until the next tick, but wakes up often enough to pick inputs up quickly
+    f64 wait = MIN(last_tick + sim.game.tick_wait - glfwGetTime(), SIM_POLL);
+    if (wait > 0) nanosleep(&(struct timespec) { 0, wait * 1e9 }, NULL);
   }
 
-  // Teleport through walls
-  if (snake.body[snake.size][0] >= tiles) snake.body[snake.size][0] = 0;
-  if (snake.body[snake.size][2] >= tiles) snake.body[snake.size][2] = 0;
-  if (snake.body[snake.size][0] < 0) snake.body[snake.size][0] = tiles - 1;
-  if (snake.body[snake.size][2] < 0) snake.body[snake.size][2] = tiles - 1;
-
-  // Check for snake collision
-  for (u8 i = 1; i < snake.size; i++)
-    if (VEC3_COMPARE(snake.body[i], snake.body[snake.size])) {
-      tick_wait = TICK_WAIT * 0.25;
-      game_end = snake.size;
-      play_audio("death");
+  return NULL;
+}
+
+// Steps the arena instead of the game, the player's inputs go to the first snake and the bots steer the rest
+void* arena_thread(void* data) {
+  TRACE_THREAD("arena");
+  Arena* arena = sim.arena;
+  u8* inputs = malloc(arena->count);
+  f64 last_tick = 0;
+
+  while (!atomic_load(&sim.quit)) {
+    u8 input;
+    while (input_pop(&sim.inputs, &input)) {
+      pthread_mutex_lock(&sim.arena_lock);
+      arena_input(arena, 0, input);
+      pthread_mutex_unlock(&sim.arena_lock);
     }
 
-  // Check for apple collision
-  if (VEC3_COMPARE(snake.body[snake.size], apple)) {
-    snake.size++;
-    if (snake.size > tiles * tiles / 3) {
-      tiles += 1;
-      target_fov += PI4 / 20;
-      VEC3_COPY(VEC3(tiles * 0.6, tiles * 1.7, tiles * 1.6), target_pos);
+    f64 tick = glfwGetTime();
+    if (tick - last_tick > ARENA_TICK) {
+      last_tick = tick;
+
+      // Only this thread writes the arena, so the bots can read it without the lock
+      inputs[0] = INPUT_OTHER;
+      for (u32 i = 1; i < arena->count; i++) inputs[i] = arena_steer(arena, i);
+
+      pthread_mutex_lock(&sim.arena_lock);
+      TRACE_BEGIN("arena_step");
+      arena_step(arena, inputs);
+      TRACE_END();
+      pthread_mutex_unlock(&sim.arena_lock);
     }
 
-    play_audio("apple");
-    randomize_apple();
+    f64 wait = MIN(last_tick + ARENA_TICK - glfwGetTime(), SIM_POLL);
+    if (wait > 0) nanosleep(&(struct timespec) { 0, wait * 1e9 }, NULL);
+  }
+
+  free(inputs);
+  return NULL;
+}
+
+// Plays a sound for every kind of event the sim counted since the last frame
+void play_events() {
+  static u32 heard[EVENT_AMOUNT];
+
+  for (u8 i = 0; i < EVENT_AMOUNT; i++) {
+    if (game->events[i] == heard[i]) continue;
+    play_audio(EVENT_SOUNDS[i]);
+    heard[i] = game->events[i];
   }
-  // If didn't eat apple, remove last block
-  else
-    for (u8 i = 1; i < snake.size + 1; i++) 
-      VEC3_COPY(snake.body[i], snake.body[i - 1]);
-
-  play_audio("move");
-  snake.last_dir = snake.dir;
-  if (snake.dir != FRONT && snake.dir != BACK) snake.last_plane_dir = snake.dir;
-  return;
 }
@@ -2,13 +2,6 @@
 
 // --- Struct
 
-struct Material {
-  vec3 COL;
-  sampler2D S_DIF, S_EMT;
-  float AMB, DIF;
-  int LIG;
-};
-
 struct DirLig {
   vec3 COL, DIR;
 };
@@ -26,31 +19,47 @@ struct SptLig {
 // --- Setup
 
 uniform vec2 TEX_SCALE;
-uniform Material MAT;
-uniform DirLig DIR_LIGS[10];
-uniform PntLig PNT_LIGS[10];
-uniform SptLig SPT_LIGS[10];
+uniform sampler2D S_DIF, S_EMT;
 
-uniform int DIR_LIG_AMOUNT;
-uniform int PNT_LIG_AMOUNT;
-uniform int SPT_LIG_AMOUNT;
+layout (std140) uniform MaterialBlock {
+  vec3  COL;
+  float AMB, DIF;
+  int   LIG;
+  float GRD, ORG;
+} MAT;
+
+layout (std140) uniform LightBlock {
+  DirLig DIR_LIGS[10];
+  PntLig PNT_LIGS[10];
+  SptLig SPT_LIGS[10];
+
+  int DIR_LIG_AMOUNT;
+  int PNT_LIG_AMOUNT;
+  int SPT_LIG_AMOUNT;
+};
 
 in  vec3 nrm;
 in  vec3 pos;
 in  vec2 tex;
+in  float seg;
+in  vec4 tint;
 out vec4 color;
 
+// Material color shifted along the segments of a mesh, meshes without segments keep it as is,
+// then mixed with the instance tint, which defaults to none
+vec3 col;
+
 // --- Function
 
 vec3 CalcDirLig(DirLig lig, vec3 normal) {
   vec3 light_dir = normalize(-lig.DIR);
 
-  vec3 ambient = lig.COL * MAT.COL * MAT.AMB;
-  ambient *= vec3(texture(MAT.S_DIF, tex));
-  ambient += vec3(texture(MAT.S_EMT, tex));
+  vec3 ambient = lig.COL * col * MAT.AMB;
+  ambient *= vec3(texture(S_DIF, tex));
+  ambient += vec3(texture(S_EMT, tex));
 
-  vec3 diffuse = lig.COL * MAT.COL * MAT.DIF * max(dot(normal, light_dir), 0);
-  diffuse *= vec3(texture(MAT.S_DIF, tex));
+  vec3 diffuse = lig.COL * col * MAT.DIF * max(dot(normal, light_dir), 0);
+  diffuse *= vec3(texture(S_DIF, tex));
 
   return ambient + diffuse;
 }
@@ -61,12 +70,12 @@ vec3 CalcPntLig(PntLig lig, vec3 normal) {
   float distance = length(lig.POS - pos);
   float attenuation = 1 / (lig.CON + lig.LIN * distance + lig.QUA * distance * distance);
 
-  vec3 ambient = attenuation * lig.COL * MAT.COL * MAT.AMB;
-  ambient *= vec3(texture(MAT.S_DIF, tex));
-  ambient += vec3(texture(MAT.S_EMT, tex));
+  vec3 ambient = attenuation * lig.COL * col * MAT.AMB;
+  ambient *= vec3(texture(S_DIF, tex));
+  ambient += vec3(texture(S_EMT, tex));
 
-  vec3 diffuse = attenuation * lig.COL * MAT.COL * MAT.DIF * max(dot(normalize(normal), light_dir), 0);
-  diffuse *= vec3(texture(MAT.S_DIF, tex));
+  vec3 diffuse = attenuation * lig.COL * col * MAT.DIF * max(dot(normalize(normal), light_dir), 0);
+  diffuse *= vec3(texture(S_DIF, tex));
 
   return ambient + diffuse;
 }
@@ -81,12 +90,12 @@ vec3 CalcSptLig(SptLig lig, vec3 normal) {
   float distance = length(lig.POS - pos);
   float attenuation = 1 / (lig.CON + lig.LIN * distance + lig.QUA * distance * distance);
 
-  vec3 ambient = attenuation * lig.COL * MAT.COL * MAT.AMB;
-  ambient *= vec3(texture(MAT.S_DIF, tex));
-  ambient += vec3(texture(MAT.S_EMT, tex));
+  vec3 ambient = attenuation * lig.COL * col * MAT.AMB;
+  ambient *= vec3(texture(S_DIF, tex));
+  ambient += vec3(texture(S_EMT, tex));
 
-  vec3 diffuse = intensity * attenuation * lig.COL * MAT.COL * MAT.DIF * max(dot(normalize(normal), light_dir), 0);
-  diffuse *= vec3(texture(MAT.S_DIF, tex));
+  vec3 diffuse = intensity * attenuation * lig.COL * col * MAT.DIF * max(dot(normalize(normal), light_dir), 0);
+  diffuse *= vec3(texture(S_DIF, tex));
 
   return ambient + diffuse;
 }
@@ -94,10 +103,11 @@ vec3 CalcSptLig(SptLig lig, vec3 normal) {
 // --- Main
 
 void main() {
-  if (vec3(texture(MAT.S_DIF, tex)) == vec3(0, 1, 0)) {
+  if (vec3(texture(S_DIF, tex)) == vec3(0, 1, 0)) {
     discard;
   }
 
+  col = mix(tint.rgb, MAT.COL + (floor(seg) - MAT.ORG) * MAT.GRD, tint.a);
   vec3 _color = vec3(0);
 
   if (MAT.LIG == 0) {
@@ -114,7 +124,7 @@ void main() {
         _color += CalcSptLig(SPT_LIGS[i], nrm);
   }
   else {
-    _color = MAT.COL;
+    _color = col;
   }
 
   if (nrm.y < -0.5 || nrm.x > 0.5 || nrm.z > 0.5) {
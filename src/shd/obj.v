@@ -3,6 +3,9 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNrm;
 layout (location = 2) in vec2 aTex;
+layout (location = 3) in float aSeg;
+layout (location = 4) in vec3 aOffset;
+layout (location = 5) in vec4 aTint;
 uniform mat4 MODEL;
 uniform mat4 VIEW;
 uniform mat4 PROJ;
@@ -11,10 +14,14 @@ uniform int TILE;
 out vec3 pos;
 out vec3 nrm;
 out vec2 tex;
+out float seg;
+out vec4 tint;
 
 void main() {
-  pos = vec3(MODEL * vec4(aPos, 1));
+  pos = vec3(MODEL * vec4(aPos, 1)) + aOffset;
   nrm = aNrm;
+  seg = aSeg;
+  tint = aTint;
   tex = vec2((aTex.x + TILE) / max(TILE_AMOUNT, 1), aTex.y);
-  gl_Position = PROJ * VIEW * MODEL * vec4(aPos, 1);
+  gl_Position = PROJ * VIEW * vec4(pos, 1);
 }
@@ -0,0 +1,426 @@
+#pragma once
+#include <stdatomic.h>
+#include "types.h"
+
+// Snake
+
+// The game itself, free of GL, audio and time so it can be stepped from any thread
+// Sounds are reported as counters of events, so whoever plays them can tell how many it missed
+
+#define TICK_WAIT 0.4
+#define START_SIZE 3
+#define MAX_TILES 25
+#define MAX_SIZE 255 // Snake.size is a u8, a snake this long runs over apples without growing
+#define TILES 10
+#define START_FOV (3.14159 / 4)
+
+enum { UP, RIGHT, DOWN, LEFT, FRONT, BACK } Direction;
+enum { INPUT_UP, INPUT_DOWN, INPUT_RIGHT, INPUT_LEFT, INPUT_LAYER, INPUT_MENU, INPUT_OTHER } Input;
+enum { EVENT_APPLE, EVENT_MOVE, EVENT_HIT, EVENT_DEATH, EVENT_START, EVENT_AMOUNT } Event;
+
+typedef struct {
+  i8 body[MAX_TILES * MAX_TILES * 2][3];
+  u8 size;
+  u8 dir;
+  u8 last_dir;
+  u8 last_plane_dir;
+} Snake;
+
+typedef struct {
+  Snake snake;
+  u8 apple[3];
+  u8 tiles, menu, game_end;
+  f32 tick_wait, target_fov, target_pos[3];
+  u32 rng, events[EVENT_AMOUNT];
+  u64 hash;
+} Game;
+
+// Zobrist
+
+// Game.hash fingerprints the board: the cells of the body, which one is the head, the apple, the
+// direction and the board size, each toggling its own key in or out so every change is O(1)
+// Keys are splitmix64 of the kind and index, so there's no table to build or share between threads
+// Define SNAKE_VERIFY_HASH to check it against game_hash after every change
+
+enum { ZOBRIST_BODY, ZOBRIST_HEAD, ZOBRIST_APPLE, ZOBRIST_DIR, ZOBRIST_TILES } ZobristKind;
+
+u64 zobrist_key(u8 kind, u32 index) {
+  u64 z = ((u64) kind << 32 | index) * 0x9e3779b97f4a7c15 + 0x9e3779b97f4a7c15;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+u32 _zobrist_cell(i32 x, i32 y, i32 z) {
+  return (y * MAX_TILES + z) * MAX_TILES + x;
+}
+
+void _hash_body(Game* game, i8* cell) {
+  game->hash ^= zobrist_key(ZOBRIST_BODY, _zobrist_cell(cell[0], cell[1], cell[2]));
+}
+
+void _hash_head(Game* game, i8* cell) {
+  game->hash ^= zobrist_key(ZOBRIST_HEAD, _zobrist_cell(cell[0], cell[1], cell[2]));
+}
+
+void _hash_apple(Game* game) {
+  game->hash ^= zobrist_key(ZOBRIST_APPLE, _zobrist_cell(game->apple[0], game->apple[1], game->apple[2]));
+}
+
+// The hash computed from scratch, O(size)
+u64 game_hash(Game* game) {
+  Snake* snake = &game->snake;
+  Game hashed = { .apple = { game->apple[0], game->apple[1], game->apple[2] } };
+
+  for (u32 i = 0; i < snake->size; i++) _hash_body(&hashed, snake->body[i]);
+  if (snake->size) _hash_head(&hashed, snake->body[snake->size - 1]);
+  _hash_apple(&hashed);
+  return hashed.hash ^ zobrist_key(ZOBRIST_DIR, snake->dir) ^ zobrist_key(ZOBRIST_TILES, game->tiles);
+}
+
+#ifdef SNAKE_VERIFY_HASH
+#define HASH_VERIFY(game) ASSERT((game)->hash == game_hash(game), "Zobrist hash drifted (%llx, %llx from scratch)", (unsigned long long) (game)->hash, (unsigned long long) game_hash(game))
+#else
+#define HASH_VERIFY(game)
+#endif
+
+void _game_turn(Game* game, u8 dir) {
+  game->hash ^= zobrist_key(ZOBRIST_DIR, game->snake.dir) ^ zobrist_key(ZOBRIST_DIR, dir);
+  game->snake.dir = dir;
+}
+
+// xorshift32, each game has its own so games on different threads don't share rand()
+u32 game_rand(Game* game, u32 max) {
+  game->rng ^= game->rng << 13;
+  game->rng ^= game->rng >> 17;
+  game->rng ^= game->rng << 5;
+  return game->rng % max;
+}
+
+void game_randomize_apple(Game* game) {
+  _hash_apple(game);
+  u8 taken;
+  do {
+    game->apple[0] = game_rand(game, game->tiles);
+    game->apple[1] = game_rand(game, 2);
+    game->apple[2] = game_rand(game, game->tiles);
+
+    taken = 0;
+    for (u8 i = 0; i < game->snake.size; i++)
+      if (VEC3_COMPARE(game->snake.body[i], game->apple)) taken = 1;
+  } while (taken);
+  _hash_apple(game);
+}
+
+void game_init(Game* game, u32 seed) {
+  *game = (Game) {
+    .snake = { { { TILES / 2, 0, TILES / 2 }, { TILES / 2 + 1, 0, TILES / 2 }, { TILES / 2 + 2, 0, TILES / 2 } }, START_SIZE, RIGHT, RIGHT, RIGHT },
+    .tiles = TILES,
+    .menu = 1,
+    .tick_wait = TICK_WAIT,
+    .target_fov = START_FOV,
+    .target_pos = { TILES * 0.6, TILES * 1.5, TILES * 1.3 },
+    .rng = seed ? seed : 1
+  };
+  game_randomize_apple(game);
+  game->hash = game_hash(game);
+}
+
+// The budget scene, a serpentine snake with every third row raised on a board just big enough for it
+void game_budget_scene(Game* game, u8 length) {
+  u8 tiles = TILES;
+  while (tiles * tiles < length) tiles++;
+
+  game->menu = 0;
+  game->tiles = tiles;
+  game->snake.size = length;
+
+  for (u8 i = 0; i < length; i++) {
+    game->snake.body[i][0] = (i / tiles) % 2 ? tiles - 1 - i % tiles : i % tiles;
+    game->snake.body[i][1] = (i / tiles) % 3 == 2;
+    game->snake.body[i][2] = i / tiles;
+  }
+
+  game->apple[0] = game->apple[2] = tiles - 1;
+  game->apple[1] = 1;
+  game->hash = game_hash(game);
+}
+
+// Applies an input, returns 1 when it turned the snake so the next tick should come sooner
+u8 game_input(Game* game, u8 input) {
+  Snake* snake = &game->snake;
+
+  if (input == INPUT_MENU) {
+    game->menu = 1;
+    return 0;
+  }
+
+  if (game->menu) {
+    game->menu = 0;
+    game->events[EVENT_START]++;
+  }
+
+  u8 turned = 0;
+  switch (input) {
+    case INPUT_UP:    if (snake->last_dir !=  DOWN) { _game_turn(game,    UP); turned = 1; } break;
+    case INPUT_DOWN:  if (snake->last_dir !=    UP) { _game_turn(game,  DOWN); turned = 1; } break;
+    case INPUT_RIGHT: if (snake->last_dir !=  LEFT) { _game_turn(game, RIGHT); turned = 1; } break;
+    case INPUT_LEFT:  if (snake->last_dir != RIGHT) { _game_turn(game,  LEFT); turned = 1; } break;
+
+    case INPUT_LAYER:
+      // There's no head to move between shrinking away and respawning
+      if (!snake->size) break;
+      if      (snake->body[snake->size - 1][1] == 0 && snake->last_dir !=  BACK) { _game_turn(game, FRONT); turned = 1; }
+      else if (snake->body[snake->size - 1][1] == 1 && snake->last_dir != FRONT) { _game_turn(game,  BACK); turned = 1; }
+      break;
+  }
+
+  HASH_VERIFY(game);
+  return turned;
+}
+
+// The board a snake that just grew to size cells is on, one bigger once it's a third full, up to MAX_TILES
+u8 game_grown_tiles(u8 tiles, u32 size) {
+  return tiles + (size > tiles * tiles / 3 && tiles < MAX_TILES);
+}
+
+// The new head is on the apple, the tail stays and the board may grow
+void _game_eat(Game* game) {
+  Snake* snake = &game->snake;
+  snake->size++;
+  if (game_grown_tiles(game->tiles, snake->size) != game->tiles) {
+    game->hash ^= zobrist_key(ZOBRIST_TILES, game->tiles) ^ zobrist_key(ZOBRIST_TILES, game->tiles + 1);
+    game->tiles += 1;
+    game->target_fov += START_FOV / 20;
+    game->target_pos[0] = game->tiles * 0.6;
+    game->target_pos[1] = game->tiles * 1.7;
+    game->target_pos[2] = game->tiles * 1.6;
+  }
+
+  game->events[EVENT_APPLE]++;
+  game_randomize_apple(game);
+}
+
+const i8 STEP_DELTA[6][3] = { { 0, 0, 1 }, { 1, 0, 0 }, { 0, 0, -1 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 } };
+
+// Moves an i32 cell one step in dir, x and z go through the walls to the other side of the board and
+// y isn't bounded, a layer switch past either layer bounces before it gets here
+// On a power of two board a mask wraps both sides, the others compare against each. The step kernels
+// expand it with tiles a constant so only the wrap of their size is left, the rest call game_step_head
+#define GAME_STEP_HEAD(cell, dir, tiles) { \
+  const i8* delta_ = STEP_DELTA[dir]; \
+  cell[0] += delta_[0]; \
+  cell[1] += delta_[1]; \
+  cell[2] += delta_[2]; \
+  if (!((tiles) & ((tiles) - 1))) { \
+    cell[0] &= (tiles) - 1; \
+    cell[2] &= (tiles) - 1; \
+  } \
+  else { \
+    cell[0] = cell[0] >= (tiles) ? 0 : cell[0] < 0 ? (tiles) - 1 : cell[0]; \
+    cell[2] = cell[2] >= (tiles) ? 0 : cell[2] < 0 ? (tiles) - 1 : cell[2]; \
+  } \
+}
+
+void game_step_head(i32 cell[3], u8 dir, i32 tiles) {
+  GAME_STEP_HEAD(cell, dir, tiles);
+}
+
+void game_step(Game* game) {
+  Snake* snake = &game->snake;
+  if (game->menu) return;
+
+  if (game->game_end) {
+    if (!snake->size && game->tick_wait == TICK_WAIT * 5) {
+      for (u8 i = 0; i < START_SIZE; i++) {
+        snake->body[i][0] = snake->body[game->game_end - 3 + i][0];
+        snake->body[i][1] = snake->body[game->game_end - 3 + i][1];
+        snake->body[i][2] = snake->body[game->game_end - 3 + i][2];
+      }
+
+      game->tick_wait = TICK_WAIT;
+      snake->size = START_SIZE;
+      game->game_end = 0;
+      game->events[EVENT_START]++;
+      game->hash = game_hash(game);
+    }
+    else if (!snake->size) game->tick_wait = TICK_WAIT * 5;
+    else {
+      // The snake shrinks from the head, the cell before it takes its place
+      _hash_head(game, snake->body[snake->size - 1]);
+      _hash_body(game, snake->body[snake->size - 1]);
+      snake->size--;
+      if (snake->size) _hash_head(game, snake->body[snake->size - 1]);
+      game->tick_wait *= 0.95;
+      game->events[EVENT_HIT]++;
+    }
+    HASH_VERIFY(game);
+    return;
+  }
+
+  // If going to hit a border on y-axis, get back to a plane direction
+  if ((snake->dir == FRONT && snake->body[snake->size - 1][1] == 1) || (snake->dir == BACK && snake->body[snake->size - 1][1] == 0))
+    _game_turn(game, snake->last_plane_dir);
+
+  // Create the new head outbound before shifting the snake
+  i8* head = snake->body[snake->size - 1];
+  i32 next[3] = { head[0], head[1], head[2] };
+  game_step_head(next, snake->dir, game->tiles);
+  VEC3_COPY(next, snake->body[snake->size]);
+
+  _hash_head(game, snake->body[snake->size - 1]);
+  _hash_head(game, snake->body[snake->size]);
+  _hash_body(game, snake->body[snake->size]);
+
+  // Check for snake collision
+  for (u8 i = 1; i < snake->size; i++)
+    if (VEC3_COMPARE(snake->body[i], snake->body[snake->size])) {
+      game->tick_wait = TICK_WAIT * 0.25;
+      game->game_end = snake->size;
+      game->events[EVENT_DEATH]++;
+    }
+
+  // Check for apple collision
+  if (VEC3_COMPARE(snake->body[snake->size], game->apple) && snake->size < MAX_SIZE) _game_eat(game);
+  // If didn't eat apple, remove last block
+  else {
+    _hash_body(game, snake->body[0]);
+    for (u32 i = 1; i <= snake->size; i++)
+      VEC3_COPY(snake->body[i], snake->body[i - 1]);
+  }
+
+  game->events[EVENT_MOVE]++;
+  snake->last_dir = snake->dir;
+  if (snake->dir != FRONT && snake->dir != BACK) snake->last_plane_dir = snake->dir;
+  HASH_VERIFY(game);
+}
+
+// Step Kernels
+
+// game_step compiled for one board size, for the batches stepped millions of times when training
+// With tiles a constant, GAME_STEP_HEAD folds to the wrap of that size, a mask on power of two sizes
+// and a compare on each side on the others, the collision scan is unrolled and the body shifts with
+// one memmove. The menu and the end of a game aren't hot and go to game_step
+// game_step_fast picks the kernel for the current size, the board grows as the snake does and sizes
+// without a kernel fall back to game_step, both give exactly the same game, hash and rng included
+
+#define GAME_STEP_SIZES(X) X(10) X(11) X(12) X(16)
+
+// How many cells of the body past the tail are on cell, the tail is moving out of the way
+u32 _step_hits(i8 (*body)[3], u32 size, i8* cell) {
+  #define _STEP_HIT(i) ((body[i][0] == cell[0]) & (body[i][1] == cell[1]) & (body[i][2] == cell[2]))
+  u32 hits = 0, i = 1;
+  for (; i + 4 <= size; i += 4) hits += _STEP_HIT(i) + _STEP_HIT(i + 1) + _STEP_HIT(i + 2) + _STEP_HIT(i + 3);
+  for (; i < size; i++) hits += _STEP_HIT(i);
+  return hits;
+  #undef _STEP_HIT
+}
+
+#define GAME_STEP_KERNEL(T) \
+void game_step_##T(Game* game) { \
+  Snake* snake = &game->snake; \
+  if (game->menu || game->game_end || game->tiles != T) { \
+    game_step(game); \
+    return; \
+  } \
+  \
+  i8* head = snake->body[snake->size - 1]; \
+  i8* next = snake->body[snake->size]; \
+  if ((snake->dir == FRONT && head[1] == 1) || (snake->dir == BACK && head[1] == 0)) \
+    _game_turn(game, snake->last_plane_dir); \
+  \
+  i32 cell[3] = { head[0], head[1], head[2] }; \
+  GAME_STEP_HEAD(cell, snake->dir, T); \
+  VEC3_COPY(cell, next); \
+  _hash_head(game, head); \
+  _hash_head(game, next); \
+  _hash_body(game, next); \
+  \
+  u32 hits = _step_hits(snake->body, snake->size, next); \
+  if (hits) { \
+    game->tick_wait = TICK_WAIT * 0.25; \
+    game->game_end = snake->size; \
+    game->events[EVENT_DEATH] += hits; \
+  } \
+  \
+  if (VEC3_COMPARE(next, game->apple) && snake->size < MAX_SIZE) _game_eat(game); \
+  else { \
+    _hash_body(game, snake->body[0]); \
+    memmove(snake->body[0], snake->body[1], snake->size * sizeof(snake->body[0])); \
+  } \
+  \
+  game->events[EVENT_MOVE]++; \
+  snake->last_dir = snake->dir; \
+  if (snake->dir != FRONT && snake->dir != BACK) snake->last_plane_dir = snake->dir; \
+  HASH_VERIFY(game); \
+}
+
+GAME_STEP_SIZES(GAME_STEP_KERNEL)
+
+void game_step_fast(Game* game) {
+  #define _GAME_STEP_CASE(T) case T: game_step_##T(game); return;
+  switch (game->tiles) {
+    GAME_STEP_SIZES(_GAME_STEP_CASE)
+  }
+  game_step(game);
+  #undef _GAME_STEP_CASE
+}
+
+// Snapshots
+
+// Triple buffer between the simulation and the renderer, neither side ever waits on the other
+// The writer fills its back slot and swaps it with the middle one, the reader swaps its front slot
+// with the middle only when SNAPSHOT_FRESH says something newer was published since it last looked
+
+#define SNAPSHOT_FRESH 4
+
+typedef struct {
+  Game slots[3];
+  atomic_uint middle;
+  u32 back, front;
+} Snapshots;
+
+void snapshots_init(Snapshots* snapshots) {
+  snapshots->back = 0;
+  atomic_init(&snapshots->middle, 1);
+  snapshots->front = 2;
+}
+
+void snapshots_publish(Snapshots* snapshots, Game* game) {
+  snapshots->slots[snapshots->back] = *game;
+  snapshots->back = atomic_exchange_explicit(&snapshots->middle, snapshots->back | SNAPSHOT_FRESH, memory_order_acq_rel) & ~SNAPSHOT_FRESH;
+}
+
+// Newest published game, stays valid until the next call
+Game* snapshots_read(Snapshots* snapshots) {
+  if (atomic_load_explicit(&snapshots->middle, memory_order_relaxed) & SNAPSHOT_FRESH)
+    snapshots->front = atomic_exchange_explicit(&snapshots->middle, snapshots->front, memory_order_acq_rel) & ~SNAPSHOT_FRESH;
+  return &snapshots->slots[snapshots->front];
+}
+
+// Input Queue
+
+// Single producer, single consumer ring, inputs are dropped if the consumer falls INPUT_QUEUE behind
+
+#define INPUT_QUEUE 64
+
+typedef struct {
+  u8 inputs[INPUT_QUEUE];
+  atomic_uint head, tail;
+} InputQueue;
+
+u8 input_push(InputQueue* queue, u8 input) {
+  u32 tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  if (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == INPUT_QUEUE) return 0;
+  queue->inputs[tail % INPUT_QUEUE] = input;
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+  return 1;
+}
+
+u8 input_pop(InputQueue* queue, u8* input) {
+  u32 head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  if (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) return 0;
+  *input = queue->inputs[head % INPUT_QUEUE];
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+  return 1;
+}
@@ -0,0 +1,319 @@
+// Snake Mesh
+
+// The body is kept as straight runs of cells, each drawn as one stretched box in a fixed slot
+// of a ring buffer, faces touching the previous or next cell and the floor are left out
+// Advancing the head or retracting the tail only rewrites the slots of the runs at the ends
+// Runs don't cross chunk borders, so whole chunks of the board can be culled before drawing
+
+#include <float.h>
+
+#define RUN_VERTEXES 36
+#define RUN_STRIDE   9
+#define RUN_NO_DIR   6
+
+typedef struct {
+  i8 start[3];
+  u8 dir, chunk;
+  u16 length;
+  u32 serial;
+} SnakeRun;
+
+typedef struct {
+  Model model;
+  SnakeRun* runs;
+  u32 capacity, first, count;
+  u16 size;
+  u8 rebuilding, chunk, row;
+  CullBoxes boxes;
+  u8 occupied[CULL_MAX], visible[CULL_MAX];
+  u32 visible_chunks, culled_chunks;
+  i32 *firsts, *counts;
+  f32 vertexes[RUN_VERTEXES * RUN_STRIDE];
+} SnakeMesh;
+
+const i8 RUN_DIRS[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+
+SnakeMesh* snake_mesh_create(u32 capacity, u8 board, u8 chunk, Material* material) {
+  SnakeMesh* mesh = calloc(1, sizeof(SnakeMesh));
+  mesh->capacity = capacity;
+  mesh->runs = calloc(capacity, sizeof(SnakeRun));
+  mesh->firsts = malloc(capacity * sizeof(i32));
+  mesh->counts = malloc(capacity * sizeof(i32));
+  mesh->chunk = chunk;
+  mesh->row = (board + chunk - 1) / chunk;
+  mesh->boxes.size = mesh->row * mesh->row;
+  ASSERT(mesh->boxes.size <= CULL_MAX, "Too many chunks (%u)", mesh->boxes.size);
+  memset(mesh->visible, 1, sizeof(mesh->visible));
+  mesh->model.material = material;
+  mesh->model.size = capacity * RUN_VERTEXES;
+
+  mesh->model.VAO = canvas_create_VAO();
+  mesh->model.VBO = canvas_create_VBO(capacity * sizeof(mesh->vertexes), NULL, GL_DYNAMIC_DRAW);
+  canvas_vertex_attrib_pointer(0, 3, GL_FLOAT, GL_FALSE, RUN_STRIDE * sizeof(f32), (void*) 0);
+  canvas_vertex_attrib_pointer(1, 3, GL_FLOAT, GL_FALSE, RUN_STRIDE * sizeof(f32), (void*) (3 * sizeof(f32)));
+  canvas_vertex_attrib_pointer(2, 2, GL_FLOAT, GL_FALSE, RUN_STRIDE * sizeof(f32), (void*) (6 * sizeof(f32)));
+  canvas_vertex_attrib_pointer(3, 1, GL_FLOAT, GL_FALSE, RUN_STRIDE * sizeof(f32), (void*) (8 * sizeof(f32)));
+  return mesh;
+}
+
+// Direction from a to b when they are neighbours, RUN_NO_DIR otherwise (walls are teleported through)
+u8 _run_dir(i8* a, i8* b) {
+  for (u8 i = 0; i < 6; i++)
+    if (a[0] + RUN_DIRS[i][0] == b[0] && a[1] + RUN_DIRS[i][1] == b[1] && a[2] + RUN_DIRS[i][2] == b[2]) return i;
+  return RUN_NO_DIR;
+}
+
+void _run_cell(SnakeRun* run, u16 k, i8* cell) {
+  u8 dir = run->dir == RUN_NO_DIR ? 0 : run->dir;
+  for (u8 i = 0; i < 3; i++) cell[i] = run->start[i] + RUN_DIRS[dir][i] * k;
+}
+
+u8 snake_mesh_chunk(SnakeMesh* mesh, i8* cell) {
+  return cell[0] / mesh->chunk + cell[2] / mesh->chunk * mesh->row;
+}
+
+SnakeRun* _snake_mesh_run(SnakeMesh* mesh, u32 i) {
+  return &mesh->runs[(mesh->first + i) % mesh->capacity];
+}
+
+u32 snake_mesh_head_serial(SnakeMesh* mesh) {
+  SnakeRun* last = _snake_mesh_run(mesh, mesh->count - 1);
+  return last->serial + last->length - 1;
+}
+
+// Builds the box of the run at index i, hidden faces are left as degenerate triangles
+void _snake_mesh_build(SnakeMesh* mesh, u32 i, f32* vertexes) {
+  SnakeRun* run = _snake_mesh_run(mesh, i);
+  memset(vertexes, 0, RUN_VERTEXES * RUN_STRIDE * sizeof(f32));
+
+  i8 end[3], prev[3], next[3];
+  _run_cell(run, run->length - 1, end);
+  u8 hidden[6] = { 0 };
+
+  // Faces against the cell before the run and after it are covered
+  if (i > 0) {
+    SnakeRun* before = _snake_mesh_run(mesh, i - 1);
+    _run_cell(before, before->length - 1, prev);
+    u8 dir = _run_dir(run->start, prev);
+    if (dir != RUN_NO_DIR && (run->length == 1 || dir == (run->dir ^ 1))) hidden[dir] = 1;
+  }
+  if (i + 1 < mesh->count) {
+    VEC3_COPY(_snake_mesh_run(mesh, i + 1)->start, next);
+    u8 dir = _run_dir(end, next);
+    if (dir != RUN_NO_DIR && (run->length == 1 || dir == run->dir)) hidden[dir] = 1;
+  }
+
+  vec3 min, max;
+  for (u8 a = 0; a < 3; a++) {
+    min[a] = MIN(run->start[a], end[a]) + (a == 1);
+    max[a] = MAX(run->start[a], end[a]) + (a == 1) + 1;
+  }
+
+  // The floor covers the bottom of anything on the lower layer
+  if (min[1] == 1) hidden[3] = 1;
+
+  u8 axis = run->dir == RUN_NO_DIR ? 0 : run->dir / 2;
+  u8 positive = run->dir == RUN_NO_DIR || run->dir % 2 == 0;
+
+  for (u8 face = 0; face < 6; face++) {
+    if (hidden[face]) continue;
+
+    // Tangents are picked so u x v points out of the face, keeping the winding counter clockwise
+    u8 n = face / 2, j = (n + 1) % 3, k = (n + 2) % 3;
+    u8 u = face % 2 ? k : j;
+    u8 v = face % 2 ? j : k;
+    f32 corners[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+    u8 order[6] = { 0, 1, 2, 2, 3, 0 };
+
+    for (u8 c = 0; c < 6; c++) {
+      f32* vertex = &vertexes[(face * 6 + c) * RUN_STRIDE];
+      f32* corner = corners[order[c]];
+
+      vertex[n] = face % 2 ? min[n] : max[n];
+      vertex[u] = corner[0] ? max[u] : min[u];
+      vertex[v] = corner[1] ? max[v] : min[v];
+      vertex[3 + n] = face % 2 ? -1 : 1;
+      vertex[6] = corner[0];
+      vertex[7] = corner[1];
+
+      // Serial of the segment under the vertex, floor(seg) is constant across each cell of the run
+      if (run->length == 1)    vertex[8] = run->serial + 0.5;
+      else if (n == axis)      vertex[8] = face == run->dir ? run->serial + run->length - 0.5 : run->serial + 0.5;
+      else if (positive)       vertex[8] = run->serial + vertex[axis] - min[axis];
+      else                     vertex[8] = run->serial + max[axis] - vertex[axis];
+    }
+  }
+}
+
+void _snake_mesh_write(SnakeMesh* mesh, u32 i) {
+  if (mesh->rebuilding) return;
+  _snake_mesh_build(mesh, i, mesh->vertexes);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh->model.VBO);
+  glBufferSubData(GL_ARRAY_BUFFER, (mesh->first + i) % mesh->capacity * sizeof(mesh->vertexes), sizeof(mesh->vertexes), mesh->vertexes);
+}
+
+void _snake_mesh_push(SnakeMesh* mesh, i8* cell) {
+  SnakeRun* last = mesh->count ? _snake_mesh_run(mesh, mesh->count - 1) : NULL;
+  u32 serial = last ? snake_mesh_head_serial(mesh) + 1 : 0;
+  mesh->size++;
+
+  if (last) {
+    i8 end[3];
+    _run_cell(last, last->length - 1, end);
+    u8 dir = _run_dir(end, cell);
+
+    if (dir != RUN_NO_DIR && (last->length == 1 || last->dir == dir) && snake_mesh_chunk(mesh, cell) == last->chunk) {
+      last->dir = dir;
+      last->length++;
+      _snake_mesh_write(mesh, mesh->count - 1);
+      return;
+    }
+  }
+
+  ASSERT(mesh->count < mesh->capacity, "Snake mesh is out of runs");
+  SnakeRun* run = _snake_mesh_run(mesh, mesh->count++);
+  *run = (SnakeRun) { { cell[0], cell[1], cell[2] }, RUN_NO_DIR, snake_mesh_chunk(mesh, cell), 1, serial };
+
+  if (last) _snake_mesh_write(mesh, mesh->count - 2);
+  _snake_mesh_write(mesh, mesh->count - 1);
+}
+
+void _snake_mesh_pop_tail(SnakeMesh* mesh) {
+  SnakeRun* first = _snake_mesh_run(mesh, 0);
+  mesh->size--;
+
+  if (first->length > 1) {
+    _run_cell(first, 1, first->start);
+    first->serial++;
+    if (--first->length == 1) first->dir = RUN_NO_DIR;
+    _snake_mesh_write(mesh, 0);
+    return;
+  }
+
+  // Slots outside of the ring aren't drawn, so the old one can be left as is
+  mesh->count--;
+  mesh->first = (mesh->first + 1) % mesh->capacity;
+  if (mesh->count) _snake_mesh_write(mesh, 0);
+}
+
+void _snake_mesh_pop_head(SnakeMesh* mesh) {
+  SnakeRun* last = _snake_mesh_run(mesh, mesh->count - 1);
+  mesh->size--;
+
+  if (last->length > 1) {
+    if (--last->length == 1) last->dir = RUN_NO_DIR;
+    _snake_mesh_write(mesh, mesh->count - 1);
+    return;
+  }
+
+  mesh->count--;
+  if (mesh->count) _snake_mesh_write(mesh, mesh->count - 1);
+}
+
+u8 _snake_mesh_is(SnakeMesh* mesh, u32 run, u16 k, i8* cell) {
+  i8 at[3];
+  _run_cell(_snake_mesh_run(mesh, run), k, at);
+  return VEC3_COMPARE(at, cell);
+}
+
+// Rebuilds every run from the start of the ring and uploads them at once
+void snake_mesh_rebuild(SnakeMesh* mesh, i8 (*body)[3], u16 size) {
+  mesh->first = mesh->count = mesh->size = 0;
+  mesh->rebuilding = 1;
+  for (u16 i = 0; i < size; i++) _snake_mesh_push(mesh, body[i]);
+  mesh->rebuilding = 0;
+  if (!mesh->count) return;
+
+  f32* vertexes = malloc(mesh->count * sizeof(mesh->vertexes));
+  for (u32 i = 0; i < mesh->count; i++) _snake_mesh_build(mesh, i, &vertexes[i * RUN_VERTEXES * RUN_STRIDE]);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh->model.VBO);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, mesh->count * sizeof(mesh->vertexes), vertexes);
+  free(vertexes);
+}
+
+// Brings the mesh up to date with the body, a tick only moves the ends so that's the cheap path,
+// anything the mesh can't follow (respawns, skipped ticks) rebuilds it
+void snake_mesh_update(SnakeMesh* mesh, i8 (*body)[3], u16 size) {
+  if (!size || !mesh->count) {
+    snake_mesh_rebuild(mesh, body, size);
+    return;
+  }
+
+  SnakeRun* last = _snake_mesh_run(mesh, mesh->count - 1);
+  u8 head_kept = _snake_mesh_is(mesh, mesh->count - 1, last->length - 1, size >= 2 ? body[size - 2] : body[0]);
+  u8 tail_kept = _snake_mesh_is(mesh, 0, 0, body[0]);
+
+  if (size == mesh->size && tail_kept && _snake_mesh_is(mesh, mesh->count - 1, last->length - 1, body[size - 1])) return;
+
+  if (size == mesh->size + 1 && head_kept && tail_kept) {
+    _snake_mesh_push(mesh, body[size - 1]);
+    return;
+  }
+
+  if (size == mesh->size && size >= 2 && head_kept) {
+    _snake_mesh_push(mesh, body[size - 1]);
+    _snake_mesh_pop_tail(mesh);
+    if (_snake_mesh_is(mesh, 0, 0, body[0])) return;
+  }
+  else if (size + 1 == mesh->size && tail_kept) {
+    _snake_mesh_pop_head(mesh);
+    last = _snake_mesh_run(mesh, mesh->count - 1);
+    if (_snake_mesh_is(mesh, mesh->count - 1, last->length - 1, body[size - 1])) return;
+  }
+
+  snake_mesh_rebuild(mesh, body, size);
+}
+
+// Fits a box around the runs of each chunk and tests them against the frustum
+void snake_mesh_cull(SnakeMesh* mesh, vec4 planes[6]) {
+  CullBoxes* boxes = &mesh->boxes;
+  for (u32 c = 0; c < boxes->size; c++)
+    for (u8 a = 0; a < 3; a++) {
+      boxes->min[a][c] =  FLT_MAX;
+      boxes->max[a][c] = -FLT_MAX;
+    }
+
+  memset(mesh->occupied, 0, sizeof(mesh->occupied));
+  for (u32 i = 0; i < mesh->count; i++) {
+    SnakeRun* run = _snake_mesh_run(mesh, i);
+    i8 end[3];
+    _run_cell(run, run->length - 1, end);
+    mesh->occupied[run->chunk] = 1;
+
+    for (u8 a = 0; a < 3; a++) {
+      boxes->min[a][run->chunk] = MIN(boxes->min[a][run->chunk], MIN(run->start[a], end[a]) + (a == 1));
+      boxes->max[a][run->chunk] = MAX(boxes->max[a][run->chunk], MAX(run->start[a], end[a]) + (a == 1) + 1);
+    }
+  }
+
+  canvas_cull_boxes(planes, boxes, mesh->visible);
+  mesh->visible_chunks = mesh->culled_chunks = 0;
+  for (u32 c = 0; c < boxes->size; c++) {
+    if (!mesh->occupied[c]) continue;
+    if (mesh->visible[c]) mesh->visible_chunks++;
+    else mesh->culled_chunks++;
+  }
+}
+
+u8 snake_mesh_visible(SnakeMesh* mesh, i8* cell) {
+  return mesh->visible[snake_mesh_chunk(mesh, cell)];
+}
+
+// Queues the slots of the visible runs, neighbouring ones are merged into ranges of a single multi draw
+void snake_mesh_queue(SnakeMesh* mesh, RenderQueue* queue, u32 shader, Material material, mat4 transform) {
+  u32 draws = 0;
+  for (u32 i = 0; i < mesh->count; i++) {
+    SnakeRun* run = _snake_mesh_run(mesh, i);
+    if (!mesh->visible[run->chunk]) continue;
+
+    u32 slot = (mesh->first + i) % mesh->capacity;
+    if (draws && mesh->firsts[draws - 1] + mesh->counts[draws - 1] == slot * RUN_VERTEXES)
+      mesh->counts[draws - 1] += RUN_VERTEXES;
+    else {
+      mesh->firsts[draws] = slot * RUN_VERTEXES;
+      mesh->counts[draws++] = RUN_VERTEXES;
+    }
+  }
+
+  if (draws) render_queue_push_multi(queue, shader, &mesh->model, material, transform, mesh->firsts, mesh->counts, draws);
+}
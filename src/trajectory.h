@@ -0,0 +1,406 @@
+#pragma once
+#include <pthread.h>
+#include "snake.h"
+#include "pack.h"
+
+// Trajectory
+
+// (state, action, reward) transitions streamed to shard files of up to SHARD_STEPS each
+// Shards are columnar, every column 64 byte aligned in the file so a mapped shard is used as is:
+// actions, rewards, done flags and the Zobrist hash of each state as plain arrays, then the states
+// themselves as one nibble per step saying how the body got to the next one (the direction the head
+// moved and whether it grew), the apples that respawned, and keyframes holding whole states where a
+// step isn't a plain move (a new episode, a death) and every SHARD_KEY_EVERY steps for seeking
+// Producers fill a buffer per stream and hand it to one writer thread when it's full, waiting for a
+// spare one if the writer falls behind, so memory stays at streams + SHARD_SPARES buffers
+
+#define SHARD_MAGIC     0x44524853
+#define SHARD_VERSION   1
+#define SHARD_ALIGN     64
+#define SHARD_STEPS     16384
+#define SHARD_KEYS      1024
+#define SHARD_CELLS     32768
+#define SHARD_KEY_EVERY 1024
+#define SHARD_SPARES    4
+
+// The move nibble, a direction with SHARD_GREW set when the snake ate, or SHARD_JUMP to a keyframe
+#define SHARD_GREW 0x8
+#define SHARD_JUMP 0xf
+
+enum { SHARD_ACTIONS, SHARD_REWARDS, SHARD_DONE, SHARD_HASHES, SHARD_MOVES, SHARD_APPLES, SHARD_KEYS_COLUMN, SHARD_BODIES, SHARD_COLUMNS } ShardColumn;
+
+typedef struct {
+  u32 magic, version, stream, sequence;
+  u64 first;
+  u32 steps, keys, apples, cells;
+  u32 offsets[SHARD_COLUMNS];
+  u32 size;
+} ShardHeader;
+
+// A whole state, its body is cells onwards in the bodies column and its next apple is apples onwards
+typedef struct {
+  u32 step, cell, apple, rng;
+  u16 size;
+  u8 tiles, dir, last_dir, last_plane_dir, game_end, menu;
+  u8 position[3];
+} ShardKey;
+
+typedef struct {
+  u32 stream, sequence, steps, keys, apples, cells;
+  u64 first;
+  u8 actions[SHARD_STEPS];
+  i8 rewards[SHARD_STEPS];
+  u8 done[SHARD_STEPS];
+  u64 hashes[SHARD_STEPS];
+  u8 moves[SHARD_STEPS / 2];
+  u8 apple[SHARD_STEPS][3];
+  ShardKey key[SHARD_KEYS];
+  i8 body[SHARD_CELLS][3];
+} ShardBuffer;
+
+typedef struct {
+  const c8* prefix;
+  u8 quit;
+  ShardBuffer** spares;
+  ShardBuffer** full;
+  u32 buffers, spare_count, queued, written, shards;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+} ShardWriter;
+
+// What a producer needs of the last state to tell how the next one follows from it
+typedef struct {
+  ShardWriter* writer;
+  ShardBuffer* buffer;
+  u32 id, sequence;
+  u64 steps;
+  i8 head[3];
+  u16 size;
+  u8 tiles, game_end;
+} ShardStream;
+
+// Writing
+
+u32 _shard_align(u32 offset) {
+  return (offset + SHARD_ALIGN - 1) / SHARD_ALIGN * SHARD_ALIGN;
+}
+
+void _shard_write(ShardWriter* writer, ShardBuffer* buffer) {
+  c8 path[512];
+  snprintf(path, sizeof(path), "%s-%03u-%05u.shard", writer->prefix, buffer->stream, buffer->sequence);
+  FILE* file = fopen(path, "wb");
+  ASSERT(file, "Can't write shard (%s)", path);
+
+  const void* columns[SHARD_COLUMNS] = { buffer->actions, buffer->rewards, buffer->done, buffer->hashes, buffer->moves, buffer->apple, buffer->key, buffer->body };
+  u32 sizes[SHARD_COLUMNS] = {
+    buffer->steps, buffer->steps, buffer->steps, buffer->steps * sizeof(u64), (buffer->steps + 1) / 2,
+    buffer->apples * 3, buffer->keys * sizeof(ShardKey), buffer->cells * 3
+  };
+
+  ShardHeader header = {
+    .magic = SHARD_MAGIC, .version = SHARD_VERSION, .stream = buffer->stream, .sequence = buffer->sequence, .first = buffer->first,
+    .steps = buffer->steps, .keys = buffer->keys, .apples = buffer->apples, .cells = buffer->cells
+  };
+  u32 offset = _shard_align(sizeof(ShardHeader));
+  for (u8 i = 0; i < SHARD_COLUMNS; i++) {
+    header.offsets[i] = offset;
+    offset = _shard_align(offset + sizes[i]);
+  }
+  header.size = offset;
+
+  static const u8 padding[SHARD_ALIGN];
+  fwrite(&header, sizeof(header), 1, file);
+  fwrite(padding, 1, header.offsets[0] - sizeof(header), file);
+  for (u8 i = 0; i < SHARD_COLUMNS; i++) {
+    fwrite(columns[i], 1, sizes[i], file);
+    u32 end = i + 1 < SHARD_COLUMNS ? header.offsets[i + 1] : header.size;
+    fwrite(padding, 1, end - header.offsets[i] - sizes[i], file);
+  }
+  fclose(file);
+}
+
+void* _shard_writer(void* data) {
+  ShardWriter* writer = data;
+
+  pthread_mutex_lock(&writer->lock);
+  while (1) {
+    while (writer->written == writer->queued && !writer->quit) pthread_cond_wait(&writer->wake, &writer->lock);
+    if (writer->written == writer->queued) break;
+
+    ShardBuffer* buffer = writer->full[writer->written % writer->buffers];
+    pthread_mutex_unlock(&writer->lock);
+    _shard_write(writer, buffer);
+
+    pthread_mutex_lock(&writer->lock);
+    writer->spares[writer->spare_count++] = buffer;
+    writer->written++;
+    writer->shards++;
+    pthread_cond_broadcast(&writer->wake);
+  }
+  pthread_mutex_unlock(&writer->lock);
+  return NULL;
+}
+
+// Shards are written to <prefix>-<stream>-<sequence>.shard, prefix must outlive the writer
+void shard_writer_start(ShardWriter* writer, const c8* prefix, u32 streams) {
+  u32 buffers = streams + SHARD_SPARES;
+  *writer = (ShardWriter) { .prefix = prefix, .buffers = buffers, .spare_count = buffers };
+  writer->spares = malloc(buffers * sizeof(ShardBuffer*));
+  writer->full = malloc(buffers * sizeof(ShardBuffer*));
+  for (u32 i = 0; i < buffers; i++) writer->spares[i] = malloc(sizeof(ShardBuffer));
+  pthread_mutex_init(&writer->lock, NULL);
+  pthread_cond_init(&writer->wake, NULL);
+  pthread_create(&writer->thread, NULL, _shard_writer, writer);
+}
+
+// Queues a full buffer and swaps in a spare, waiting for the writer to free one if there's none
+ShardBuffer* _shard_swap(ShardWriter* writer, ShardBuffer* buffer) {
+  pthread_mutex_lock(&writer->lock);
+  if (buffer) {
+    writer->full[writer->queued++ % writer->buffers] = buffer;
+    pthread_cond_broadcast(&writer->wake);
+  }
+  while (!writer->spare_count) pthread_cond_wait(&writer->wake, &writer->lock);
+  ShardBuffer* spare = writer->spares[--writer->spare_count];
+  pthread_mutex_unlock(&writer->lock);
+  return spare;
+}
+
+// Writes what's queued and frees the buffers, every stream must be closed first
+void shard_writer_stop(ShardWriter* writer) {
+  pthread_mutex_lock(&writer->lock);
+  writer->quit = 1;
+  pthread_cond_broadcast(&writer->wake);
+  pthread_mutex_unlock(&writer->lock);
+  pthread_join(writer->thread, NULL);
+
+  for (u32 i = 0; i < writer->spare_count; i++) free(writer->spares[i]);
+  free(writer->spares);
+  free(writer->full);
+  pthread_mutex_destroy(&writer->lock);
+  pthread_cond_destroy(&writer->wake);
+}
+
+// Queues the stream's full buffer if it has one and starts a new shard in a spare
+void _shard_begin(ShardStream* stream, ShardBuffer* full) {
+  ShardBuffer* buffer = stream->buffer = _shard_swap(stream->writer, full);
+  buffer->stream = stream->id;
+  buffer->sequence = stream->sequence++;
+  buffer->first = stream->steps;
+  buffer->steps = buffer->keys = buffer->apples = buffer->cells = 0;
+}
+
+// Starts the row of the state the next transition leaves from
+void _shard_state(ShardStream* stream, Game* game, u8 key) {
+  ShardBuffer* buffer = stream->buffer;
+  Snake* snake = &game->snake;
+  buffer->hashes[buffer->steps] = game->hash;
+
+  if (key) {
+    buffer->key[buffer->keys++] = (ShardKey) {
+      buffer->steps, buffer->cells, buffer->apples, game->rng, snake->size, game->tiles,
+      snake->dir, snake->last_dir, snake->last_plane_dir, game->game_end, game->menu,
+      { game->apple[0], game->apple[1], game->apple[2] }
+    };
+    memcpy(buffer->body[buffer->cells], snake->body, snake->size * 3);
+    buffer->cells += snake->size;
+  }
+
+  VEC3_COPY(snake->body[MAX(snake->size, 1) - 1], stream->head);
+  stream->size = snake->size;
+  stream->tiles = game->tiles;
+  stream->game_end = game->game_end;
+}
+
+void shard_stream_open(ShardStream* stream, ShardWriter* writer, u32 id, Game* first) {
+  *stream = (ShardStream) { .writer = writer, .id = id };
+  _shard_begin(stream, NULL);
+  _shard_state(stream, first, 1);
+}
+
+// The nibble that turns the last state into game, SHARD_JUMP if it's anything but a move
+u8 _shard_move(ShardStream* stream, Game* game, u8 done) {
+  Snake* snake = &game->snake;
+  if (done || stream->game_end || game->game_end || game->menu || !stream->size) return SHARD_JUMP;
+
+  u8 grew = snake->size == stream->size + 1;
+  u8 tiles = grew ? game_grown_tiles(stream->tiles, snake->size) : stream->tiles;
+  if ((!grew && snake->size != stream->size) || tiles != game->tiles) return SHARD_JUMP;
+
+  i32 head[3] = { stream->head[0], stream->head[1], stream->head[2] };
+  game_step_head(head, snake->last_dir, stream->tiles);
+  if (!VEC3_COMPARE(head, snake->body[snake->size - 1])) return SHARD_JUMP;
+  return snake->last_dir | (grew ? SHARD_GREW : 0);
+}
+
+// Records the action taken from the last state, its reward and whether it ended the episode,
+// then the state it led to, game is that state after the step
+void shard_stream_push(ShardStream* stream, u8 action, i8 reward, u8 done, Game* game) {
+  ShardBuffer* buffer = stream->buffer;
+  u32 row = buffer->steps;
+  buffer->actions[row] = action;
+  buffer->rewards[row] = reward;
+  buffer->done[row] = done;
+
+  u8 move = _shard_move(stream, game, done);
+  u8* nibble = &buffer->moves[row / 2];
+  *nibble = row % 2 ? (*nibble & 0x0f) | move << 4 : move;
+  if (move != SHARD_JUMP && move & SHARD_GREW) {
+    VEC3_COPY(game->apple, buffer->apple[buffer->apples]);
+    buffer->apples++;
+  }
+  buffer->steps++;
+  stream->steps++;
+
+  // A new shard starts on a keyframe, and one that's out of room for them is cut short
+  u8 full = buffer->steps == SHARD_STEPS || buffer->keys == SHARD_KEYS || buffer->cells + MAX_TILES * MAX_TILES * 2 > SHARD_CELLS;
+  if (full) _shard_begin(stream, buffer);
+  _shard_state(stream, game, full || move == SHARD_JUMP || stream->buffer->steps % SHARD_KEY_EVERY == 0);
+}
+
+// Replaces the last state with one that doesn't follow from it, like a game reset between steps
+void shard_stream_jump(ShardStream* stream, Game* game) {
+  ShardBuffer* buffer = stream->buffer;
+  if (buffer->keys && buffer->key[buffer->keys - 1].step == buffer->steps) buffer->cells -= buffer->key[--buffer->keys].size;
+  if (buffer->keys == SHARD_KEYS || buffer->cells + MAX_TILES * MAX_TILES * 2 > SHARD_CELLS) _shard_begin(stream, buffer);
+  _shard_state(stream, game, 1);
+}
+
+// Records a tick of game_step, ending is whether the game had already ended before it: while the
+// snake shrinks and respawns no action does anything, so those ticks aren't transitions, the state
+// after the death just jumps to the first of the next episode once it's back
+void shard_stream_step(ShardStream* stream, u8 action, i8 reward, u8 done, u8 ending, Game* game) {
+  if (!ending) shard_stream_push(stream, action, reward, done, game);
+  else if (!game->game_end) shard_stream_jump(stream, game);
+}
+
+// Queues what's left, the last state has no transition out of it so it isn't kept
+void shard_stream_close(ShardStream* stream) {
+  ShardWriter* writer = stream->writer;
+  pthread_mutex_lock(&writer->lock);
+  if (stream->buffer->steps) {
+    writer->full[writer->queued++ % writer->buffers] = stream->buffer;
+    pthread_cond_broadcast(&writer->wake);
+  }
+  else writer->spares[writer->spare_count++] = stream->buffer;
+  pthread_mutex_unlock(&writer->lock);
+  stream->buffer = NULL;
+}
+
+// Reading
+
+// A mapped shard, the columns point straight into the file
+typedef struct {
+  const u8* data;
+  u32 size;
+  const ShardHeader* header;
+  const u8* actions;
+  const i8* rewards;
+  const u8* done;
+  const u64* hashes;
+  const u8* moves;
+  const u8 (*apples)[3];
+  const ShardKey* keys;
+  const i8 (*bodies)[3];
+} Shard;
+
+u8 shard_map(Shard* shard, const c8* path) {
+  u32 size;
+  const u8* data = file_map(path, &size);
+  if (!data) return 0;
+
+  const ShardHeader* header = (const ShardHeader*) data;
+  if (size < sizeof(ShardHeader) || header->magic != SHARD_MAGIC || header->version != SHARD_VERSION || header->size != size) {
+    file_unmap(data, size);
+    return 0;
+  }
+
+  const u32* at = header->offsets;
+  *shard = (Shard) {
+    data, size, header, data + at[SHARD_ACTIONS], (const i8*) (data + at[SHARD_REWARDS]), data + at[SHARD_DONE],
+    (const u64*) (data + at[SHARD_HASHES]), data + at[SHARD_MOVES], (const u8 (*)[3]) (data + at[SHARD_APPLES]),
+    (const ShardKey*) (data + at[SHARD_KEYS_COLUMN]), (const i8 (*)[3]) (data + at[SHARD_BODIES])
+  };
+  return 1;
+}
+
+void shard_unmap(Shard* shard) {
+  file_unmap(shard->data, shard->size);
+  *shard = (Shard) { 0 };
+}
+
+u8 shard_move(Shard* shard, u32 step) {
+  return shard->moves[step / 2] >> (step % 2 * 4) & 0xf;
+}
+
+// Walks the states of a shard in order, each one rebuilt from the last by its move in O(1)
+// rng, events and the camera targets are only what they were at the last keyframe
+typedef struct {
+  Shard* shard;
+  u32 step, key, apple;
+  Game game;
+} ShardCursor;
+
+void _shard_load(ShardCursor* cursor, u32 index) {
+  const ShardKey* key = &cursor->shard->keys[index];
+  Game* game = &cursor->game;
+  *game = (Game) {
+    .snake = { .size = key->size, .dir = key->dir, .last_dir = key->last_dir, .last_plane_dir = key->last_plane_dir },
+    .apple = { key->position[0], key->position[1], key->position[2] },
+    .tiles = key->tiles, .menu = key->menu, .game_end = key->game_end,
+    .tick_wait = TICK_WAIT, .rng = key->rng, .hash = cursor->shard->hashes[key->step]
+  };
+  memcpy(game->snake.body, cursor->shard->bodies[key->cell], key->size * 3);
+  cursor->step = key->step;
+  cursor->key = index + 1;
+  cursor->apple = key->apple;
+}
+
+// Moves to the next state, returns 0 past the last one
+u8 shard_next(ShardCursor* cursor) {
+  Shard* shard = cursor->shard;
+  if (cursor->step + 1 >= shard->header->steps) return 0;
+
+  if (cursor->key < shard->header->keys && shard->keys[cursor->key].step == cursor->step + 1) {
+    _shard_load(cursor, cursor->key);
+    return 1;
+  }
+
+  Game* game = &cursor->game;
+  Snake* snake = &game->snake;
+  u8 move = shard_move(shard, cursor->step), dir = move & ~SHARD_GREW;
+  i8* last = snake->body[snake->size - 1];
+  i32 head[3] = { last[0], last[1], last[2] };
+  game_step_head(head, dir, game->tiles);
+  VEC3_COPY(head, snake->body[snake->size]);
+
+  if (move & SHARD_GREW) {
+    snake->size++;
+    game->tiles = game_grown_tiles(game->tiles, snake->size);
+    VEC3_COPY(shard->apples[cursor->apple], game->apple);
+    cursor->apple++;
+  }
+  else
+    for (u32 i = 1; i <= snake->size; i++)
+      VEC3_COPY(snake->body[i], snake->body[i - 1]);
+
+  snake->dir = snake->last_dir = dir;
+  if (dir != FRONT && dir != BACK) snake->last_plane_dir = dir;
+  game->hash = shard->hashes[++cursor->step];
+  return 1;
+}
+
+// Puts the cursor on step, starting from the keyframe before it
+void shard_seek(ShardCursor* cursor, Shard* shard, u32 step) {
+  u32 low = 0, high = shard->header->keys;
+  while (high - low > 1) {
+    u32 mid = (low + high) / 2;
+    if (shard->keys[mid].step <= step) low = mid;
+    else high = mid;
+  }
+
+  cursor->shard = shard;
+  _shard_load(cursor, low);
+  while (cursor->step < step) shard_next(cursor);
+}
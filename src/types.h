@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN(x, y) (x < y ? x : y)
+#define MAX(x, y) (x > y ? x : y)
+#define CLAMP(x, y, z) (MAX(MIN(z, y), x))
+#define CIRCULAR_CLAMP(x, y, z) ((y < x) ? z : ((y > z) ? x : y))
+#define RAND(min, max) (rand() % (max - min) + min)
+#define LEN(v) ( sizeof(v) / sizeof(v[0]) )
+#define PRINT(...) { printf(__VA_ARGS__); printf("\n"); }
+#define ASSERT(x, ...) if (!(x)) { PRINT(__VA_ARGS__); exit(1); }
+#define VEC2_COPY(v1, v2) { v2[0] = v1[0]; v2[1] = v1[1]; }
+#define VEC2_COMPARE(v1, v2) (v1[0] == v2[0] && v1[1] == v2[1])
+#define VEC3_COPY(v1, v2) { v2[0] = v1[0]; v2[1] = v1[1]; v2[2] = v1[2]; }
+#define VEC3_ADD(v1, v2) { v1[0] += v2[0]; v1[1] += v2[1]; v1[2] += v2[2]; }
+#define VEC3_COMPARE(v1, v2) (v1[0] == v2[0] && v1[1] == v2[1] && v1[2] == v2[2])
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t   i8;
+typedef int16_t  i16;
+typedef int32_t  i32;
+typedef int64_t  i64;
+typedef float    f32;
+typedef double   f64;
+typedef char     c8;
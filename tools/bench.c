@@ -0,0 +1,181 @@
+#include <time.h>
+#include "reach.h"
+#include "raster.h"
+#include "arena.h"
+
+// Benches of the CPU side of the game, none of them needs a window, GL or audio
+// reach floods random boards of every size with each kernel the build has and checks them against the BFS
+// raster draws a batch of games on the CPU at the sizes models train on, in every view and format
+// step plays the same random games through game_step and game_step_fast on boards of each size and checks they stay identical
+// arena steps arenas of each size with bots only and prints what a tick costs
+// usage: bench [reach] [raster] [step] [arena], all of them when none is given
+
+#define REACH_BOARDS 2000
+
+#define RASTER_GAMES  64
+#define RASTER_ROUNDS 200
+#define RASTER_LENGTH 60 // The longest snake of the batch, as long as the one of --gl-budget
+
+#define STEP_GAMES  256
+#define STEP_ROUNDS 2000
+
+#define ARENA_BENCH_TICKS 1000
+
+f64 seconds() {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void reach_bench() {
+  static Bitboard boards[REACH_BOARDS];
+  static u8 starts[REACH_BOARDS][3];
+  static u32 reached[FLOOD_AMOUNT][REACH_BOARDS];
+  Game game;
+  game_init(&game, 1);
+
+  for (u8 tiles = TILES; tiles <= MAX_TILES; tiles += 5) {
+    // About a third of the cells blocked, enough to split the board into pockets
+    for (u32 i = 0; i < REACH_BOARDS; i++) {
+      boards[i] = (Bitboard) { .tiles = tiles };
+      for (u8 z = 0; z < tiles; z++) boards[i].rows[0][z] = boards[i].rows[1][z] = (1u << tiles) - 1;
+      for (u32 j = 0; j < tiles * tiles * 2 / 3; j++)
+        boards[i].rows[game_rand(&game, 2)][game_rand(&game, tiles)] &= ~(1u << game_rand(&game, tiles));
+
+      u8* start = starts[i];
+      start[0] = game_rand(&game, tiles), start[1] = game_rand(&game, 2), start[2] = game_rand(&game, tiles);
+      boards[i].rows[start[1]][start[2]] |= 1u << start[0];
+    }
+
+    f64 bfs_ns = 0;
+    for (u8 kernel = FLOOD_BFS; kernel <= reach_best_flood(); kernel++) {
+      f64 start = seconds();
+      for (u32 i = 0; i < REACH_BOARDS; i++)
+        reached[kernel][i] = reach_flood(&boards[i], starts[i][0], starts[i][1], starts[i][2], kernel);
+      f64 ns = (seconds() - start) * 1e9 / REACH_BOARDS;
+      if (kernel == FLOOD_BFS) bfs_ns = ns;
+
+      for (u32 i = 0; i < REACH_BOARDS; i++)
+        ASSERT(reached[kernel][i] == reached[FLOOD_BFS][i], "%s reached %u cells, bfs %u (%ux%u board %u)", FLOOD_NAMES[kernel], reached[kernel][i], reached[FLOOD_BFS][i], tiles, tiles, i);
+      PRINT("reach %ux%u %s: %.0fns, %.2fx bfs", tiles, tiles, FLOOD_NAMES[kernel], ns, bfs_ns / ns);
+    }
+  }
+}
+
+void raster_bench() {
+  static Game games[RASTER_GAMES];
+  static Raster raster;
+  u16 sizes[][2] = { { 64, 64 }, { 84, 84 }, { 128, 128 } };
+  const c8* views[] = { "top", "oblique" };
+
+  for (u32 i = 0; i < RASTER_GAMES; i++) {
+    game_init(&games[i], i + 1);
+    game_budget_scene(&games[i], START_SIZE + i * RASTER_LENGTH / RASTER_GAMES);
+  }
+
+  for (u8 s = 0; s < LEN(sizes); s++)
+    for (u8 view = RASTER_TOP; view <= RASTER_OBLIQUE; view++)
+      for (u8 channels = 1; channels <= 3; channels += 2) {
+        raster_init(&raster, sizes[s][0], sizes[s][1], view, channels);
+        u8* pixels = malloc(RASTER_GAMES * sizes[s][0] * sizes[s][1] * channels);
+
+        f64 start = seconds();
+        for (u32 round = 0; round < RASTER_ROUNDS; round++) raster_draw_batch(&raster, games, RASTER_GAMES, pixels);
+        f64 elapsed = seconds() - start;
+        PRINT("raster %ux%u %s %s: %.0f frames/s", sizes[s][0], sizes[s][1], views[view], channels == 1 ? "gray" : "rgb", RASTER_GAMES * RASTER_ROUNDS / elapsed);
+        free(pixels);
+      }
+}
+
+// A new game already out of the menu on a board of tiles, a death restarts it so the bench stays on moves
+void step_restart(Game* game, u32 seed, u8 tiles) {
+  game_init(game, seed);
+  game->menu = 0;
+  game->tiles = tiles;
+  game_randomize_apple(game);
+  game->hash = game_hash(game);
+}
+
+void step_bench() {
+  static Game games[2][STEP_GAMES];
+  static u8 inputs[STEP_ROUNDS][STEP_GAMES];
+  u8 sizes[] = { 10, 12, 13, 16 };
+  Game rng;
+  game_init(&rng, 1);
+
+  // A turn every few ticks, anything from INPUT_MENU up is no input
+  for (u32 round = 0; round < STEP_ROUNDS; round++)
+    for (u32 i = 0; i < STEP_GAMES; i++) inputs[round][i] = game_rand(&rng, 16);
+
+  for (u8 s = 0; s < LEN(sizes); s++) {
+    f64 ns[2];
+    for (u8 fast = 0; fast < 2; fast++) {
+      for (u32 i = 0; i < STEP_GAMES; i++) step_restart(&games[fast][i], i + 1, sizes[s]);
+
+      f64 start = seconds();
+      for (u32 round = 0; round < STEP_ROUNDS; round++)
+        for (u32 i = 0; i < STEP_GAMES; i++) {
+          Game* game = &games[fast][i];
+          if (inputs[round][i] < INPUT_MENU) game_input(game, inputs[round][i]);
+          if (fast) game_step_fast(game);
+          else game_step(game);
+          if (game->game_end) step_restart(game, (round + 1) * STEP_GAMES + i, sizes[s]);
+        }
+      ns[fast] = (seconds() - start) * 1e9 / (STEP_ROUNDS * STEP_GAMES);
+    }
+
+    for (u32 i = 0; i < STEP_GAMES; i++) {
+      Game* a = &games[0][i];
+      Game* b = &games[1][i];
+      ASSERT(!memcmp(&a->snake, &b->snake, sizeof(Snake)) && VEC3_COMPARE(a->apple, b->apple) && a->tiles == b->tiles && a->rng == b->rng && a->hash == b->hash
+             && !memcmp(a->events, b->events, sizeof(a->events)), "game_step_fast diverged from game_step (%ux%u game %u)", sizes[s], sizes[s], i);
+    }
+    PRINT("step %ux%u: game_step %.1fns, game_step_fast %.1fns, %.2fx", sizes[s], sizes[s], ns[0], ns[1], ns[0] / ns[1]);
+  }
+}
+
+void arena_bench() {
+  u32 counts[] = { 100, 1000, 4000 };
+
+  for (u8 c = 0; c < LEN(counts); c++) {
+    Arena arena;
+    arena_init(&arena, arena_tiles(counts[c]), counts[c], counts[c] / 2, 1);
+    u8* inputs = malloc(arena.count);
+
+    f64 steer = 0, step = 0;
+    for (u32 tick = 0; tick < ARENA_BENCH_TICKS; tick++) {
+      f64 start = seconds();
+      for (u32 i = 0; i < arena.count; i++) inputs[i] = arena_steer(&arena, i);
+      f64 steered = seconds();
+      arena_step(&arena, inputs);
+      steer += steered - start;
+      step += seconds() - steered;
+    }
+
+    u64 length = 0;
+    for (u32 i = 0; i < arena.count; i++)
+      if (arena.snakes[i].alive) length += arena.snakes[i].size;
+
+    PRINT("arena %u snakes %ux%u: step %.1fus, %.1fns per snake, steer %.1fus, %u alive, mean length %.1f, %u deaths", arena.count, arena.tiles, arena.tiles,
+          step * 1e6 / ARENA_BENCH_TICKS, step * 1e9 / ARENA_BENCH_TICKS / arena.count, steer * 1e6 / ARENA_BENCH_TICKS, arena.alive, (f64) length / MAX(arena.alive, 1), arena.events[EVENT_DEATH]);
+    free(inputs);
+    arena_free(&arena);
+  }
+}
+
+i32 main(i32 argc, c8** argv) {
+  const c8* names[] = { "reach", "raster", "step", "arena" };
+  void (*benches[])() = { reach_bench, raster_bench, step_bench, arena_bench };
+  u8 run[LEN(names)] = { 0 };
+
+  for (i32 i = 1; i < argc; i++) {
+    u8 found = 0;
+    for (u8 b = 0; b < LEN(names); b++)
+      if (!strcmp(argv[i], names[b])) run[b] = found = 1;
+    ASSERT(found, "usage: bench [reach] [raster] [step] [arena]");
+  }
+
+  for (u8 b = 0; b < LEN(names); b++)
+    if (run[b] || argc == 1) benches[b]();
+  return 0;
+}
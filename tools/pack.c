@@ -0,0 +1,80 @@
+#include "pack.h"
+
+// Packs files into an archive read by src/pack.h, paths are stored as given so run it from src/
+// usage: pack <out.pak> [--embed <out.c>] <files...>
+
+typedef struct {
+  const c8* path;
+  PackEntry entry;
+  u8* data;
+} PackFile;
+
+i32 _compare_files(const void* a, const void* b) {
+  u64 x = ((PackFile*) a)->entry.hash;
+  u64 y = ((PackFile*) b)->entry.hash;
+  return x < y ? -1 : x > y;
+}
+
+u32 _align(u32 offset) {
+  return (offset + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+}
+
+i32 main(i32 argc, c8** argv) {
+  ASSERT(argc > 2, "usage: pack <out.pak> [--embed <out.c>] <files...>");
+  const c8* out = argv[1];
+  const c8* embed = NULL;
+  i32 first = 2;
+  if (!strcmp(argv[2], "--embed")) {
+    ASSERT(argc > 4, "usage: pack <out.pak> [--embed <out.c>] <files...>");
+    embed = argv[3];
+    first = 4;
+  }
+
+  u32 count = argc - first;
+  PackFile* files = calloc(count, sizeof(PackFile));
+
+  for (u32 i = 0; i < count; i++) {
+    files[i].path = argv[first + i];
+    files[i].entry.hash = pack_hash(files[i].path);
+
+    Asset asset = asset_load(files[i].path);
+    ASSERT(asset.data, "Can't open %s", files[i].path);
+    files[i].data = (u8*) asset.data;
+    files[i].entry.size = asset.size;
+  }
+
+  qsort(files, count, sizeof(PackFile), _compare_files);
+
+  u32 size = _align(sizeof(PackHeader) + count * sizeof(PackEntry));
+  for (u32 i = 0; i < count; i++) {
+    ASSERT(!i || files[i].entry.hash != files[i - 1].entry.hash, "Hash collision between %s and %s", files[i].path, files[i - 1].path);
+    files[i].entry.offset = size;
+    size = _align(size + files[i].entry.size + 1);
+  }
+
+  u8* pack = calloc(1, size);
+  *(PackHeader*) pack = (PackHeader) { PACK_MAGIC, PACK_VERSION, count, size };
+  for (u32 i = 0; i < count; i++) {
+    ((PackEntry*) (pack + sizeof(PackHeader)))[i] = files[i].entry;
+    memcpy(pack + files[i].entry.offset, files[i].data, files[i].entry.size);
+  }
+
+  FILE* file = fopen(out, "wb");
+  ASSERT(file && fwrite(pack, 1, size, file) == size, "Can't write %s", out);
+  fclose(file);
+
+  // The same bytes as a C array, so the archive can be linked into the binary
+  if (embed) {
+    file = fopen(embed, "w");
+    ASSERT(file, "Can't write %s", embed);
+    fprintf(file, "// Generated by tools/pack.c\n");
+    fprintf(file, "const unsigned int PACK_EMBEDDED_SIZE = %u;\n", size);
+    fprintf(file, "_Alignas(%d) const unsigned char PACK_EMBEDDED[] = {", PACK_ALIGN);
+    for (u32 i = 0; i < size; i++) fprintf(file, "%s%u,", i % 32 ? "" : "\n", pack[i]);
+    fprintf(file, "\n};\n");
+    fclose(file);
+  }
+
+  PRINT("Packed %u files into %s (%u bytes)", count, out, size);
+  return 0;
+}